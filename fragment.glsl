@@ -1,8 +1,12 @@
 #version 330 core
 
 in vec2  tex_coords;
+in vec4  v_color;
+in vec4  v_offset;
 out vec4 color;
 
+flat in int v_type;
+
 uniform vec3      u_color;
 uniform vec4      u_offset;
 uniform sampler2D u_image;
@@ -14,7 +18,10 @@ void main ()
 {
     vec2 t = tex_coords;
 
-    if (u_type == 1)
+    if (v_type == 1)
+        color = texture (u_image, t * v_offset.zw + v_offset.xy) * v_color;
+    else if (v_type == 0) color = v_color;
+    else if (u_type == 1)
         color = texture (u_image, t * u_offset.zw + u_offset.xy) * u_alpha;
     else if (u_type == 2) color = texture (u_image, t) * u_alpha;
     // else color = vec4 (0, .4, 1, u_alpha);
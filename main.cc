@@ -3,7 +3,35 @@
 #include <SDL2/SDL_image.h>
 #include <SDL2/SDL_ttf.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#ifdef __SSE__
+    #include <xmmintrin.h>
+#endif
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/resource.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#else
+    #include <malloc.h>
+#endif
 
 #include "font.xpm"
 
@@ -17,108 +45,93 @@ enum OPERATORS
 
 namespace vec
 {
-    template <class T> T operators (T a, T b, const int OP)
+    // The operator is a template argument, so each instantiation compiles
+    // down to the bare arithmetic with no switch in the loop
+    template <int OP> inline float apply (float a, float b);
+
+    template <> inline float apply<ADD> (float a, float b) { return a + b; }
+    template <> inline float apply<SUB> (float a, float b) { return a - b; }
+    template <> inline float apply<MUL> (float a, float b) { return a * b; }
+    template <> inline float apply<DIV> (float a, float b) { return a / b; }
+
+    template <int OP, class T> inline T operators (const T& a, const T& b)
     {
         T result;
 
-        for (size_t i = 0; i < a.axis; i++)
-        {
-            switch (OP)
-            {
-                case ADD: result[i] = a[i] + b[i]; break;
-                case SUB: result[i] = a[i] - b[i]; break;
-                case MUL: result[i] = a[i] * b[i]; break;
-                case DIV: result[i] = a[i] / b[i]; break;
-            }
-        }
+        for (size_t i = 0; i < T::axis; i++)
+            result.data[i] = apply<OP> (a.data[i], b.data[i]);
 
         return result;
     }
 
-    template <class T> T operators (T a, float scalar, const int OP)
+    template <int OP, class T> inline T operators (const T& a, float scalar)
     {
         T result;
 
-        for (size_t i = 0; i < a.axis; i++)
-        {
-            switch (OP)
-            {
-                case ADD: result[i] = a[i] + scalar; break;
-                case SUB: result[i] = a[i] - scalar; break;
-                case MUL: result[i] = a[i] * scalar; break;
-                case DIV: result[i] = a[i] / scalar; break;
-            }
-        }
+        for (size_t i = 0; i < T::axis; i++)
+            result.data[i] = apply<OP> (a.data[i], scalar);
 
         return result;
     }
 
-    template <class T> float length (T t)
+    template <class T> float length (const T& t)
     {
         float result = 0;
 
-        for (size_t i = 0; i < t.axis; i++) result += (t[i] * t[i]);
+        for (size_t i = 0; i < T::axis; i++) result += (t.data[i] * t.data[i]);
 
-        return fsqrt (result);
+        return sqrtf (result);
     }
 
-    template <class T> T normalize (T v) { return v / v.length (); }
+    template <class T> T normalize (const T& v) { return v / length (v); }
 
     template <class T> float& at (T& v, size_t index)
     {
-        assert (index < v.axis);
+        assert (index < T::axis);
         return v.data[index];
     }
+}
 
-    template <class T> void init (T& v)
-    {
-        for (size_t i = 0; i < v.axis; i++) v[i] = 0;
-    }
-
-    template <class T> T& copy (T& a, const T& b)
-    {
-        for (size_t i = 0; i < a.axis; i++) a[i] = b.data[i];
-
-        return a;
+#define VEC_FUNCTIONS(type)                                     \
+    type  normalize () const { return vec::normalize (*this); } \
+    float length () const { return vec::length (*this); }
+
+#define VEC_OPERATOR(type, op, OP)                                 \
+    type operator op (const type& v) const                         \
+    {                                                              \
+        return vec::operators<OP> (*this, v);                      \
+    }                                                              \
+    type operator op (float v) const                               \
+    {                                                              \
+        return vec::operators<OP> (*this, v);                      \
     }
-}
 
-#define VEC_CONSTRUCTORS(type)     \
-    type () { vec::init (*this); } \
-    type (const type& val) { vec::copy (*this, val); }
-
-#define VEC_FUNCTIONS(type)                               \
-    type  normalize () { return vec::normalize (*this); } \
-    float length () { return vec::length (*this); }
-
-#define VEC_OPERATORS(type)                                               \
-    type   operator+ (type v) { return vec::operators (*this, v, ADD); }  \
-    type   operator- (type v) { return vec::operators (*this, v, SUB); }  \
-    type   operator* (type v) { return vec::operators (*this, v, MUL); }  \
-    type   operator/ (type v) { return vec::operators (*this, v, DIV); }  \
-    type   operator+ (float v) { return vec::operators (*this, v, ADD); } \
-    type   operator- (float v) { return vec::operators (*this, v, SUB); } \
-    type   operator* (float v) { return vec::operators (*this, v, MUL); } \
-    type   operator/ (float v) { return vec::operators (*this, v, DIV); } \
-    type&  operator= (const type& val) { return vec::copy (*this, val); } \
+#define VEC_OPERATORS(type)                                        \
+    VEC_OPERATOR (type, +, ADD)                                    \
+    VEC_OPERATOR (type, -, SUB)                                    \
+    VEC_OPERATOR (type, *, MUL)                                    \
+    VEC_OPERATOR (type, /, DIV)                                    \
     float& operator[] (size_t index) { return vec::at (*this, index); }
 
-#define VEC(size)                \
-    float  data[size];           \
-    size_t axis = size;          \
-    VEC_CONSTRUCTORS (Vec##size) \
-    VEC_FUNCTIONS (Vec##size)    \
+#define VEC(size)                         \
+    static constexpr size_t axis = size;  \
+    VEC_FUNCTIONS (Vec##size)             \
     VEC_OPERATORS (Vec##size)
 
+// Plain floats, trivially copyable: safe to memcpy and to put in GL buffers
 struct Vec2
 {
-    float &x = data[0], &y = data[1];
-
-    Vec2 (float x, float y)
+    union
     {
-        data[0] = x;
-        data[1] = y;
-    }
+        struct
+        {
+            float x, y;
+        };
+        float data[2];
+    };
+
+    Vec2 () : x (0), y (0) { }
+    Vec2 (float x, float y) : x (x), y (y) { }
 
     float angle (Vec2 b)
     {
@@ -139,34 +152,39 @@ struct Vec2
 
 struct Vec3
 {
-    float &x = data[0], &y = data[1], &z = data[2];
-
-    Vec3 (float x, float y, float z)
+    union
     {
-        data[0] = x;
-        data[1] = y;
-        data[2] = z;
-    }
+        struct
+        {
+            float x, y, z;
+        };
+        float data[3];
+    };
+
+    Vec3 () : x (0), y (0), z (0) { }
+    Vec3 (float x, float y, float z) : x (x), y (y), z (z) { }
 
     VEC (3);
 };
 
 struct Vec4
 {
-    float &x = data[0], &y = data[1], &z = data[2], &w = data[3];
-
-    Vec4 (float x, float y, float z, float w)
+    union
     {
-        data[0] = x;
-        data[1] = y;
-        data[2] = z;
-        data[3] = w;
-    }
+        struct
+        {
+            float x, y, z, w;
+        };
+        float data[4];
+    };
+
+    Vec4 () : x (0), y (0), z (0), w (0) { }
+    Vec4 (float x, float y, float z, float w) : x (x), y (y), z (z), w (w) { }
 
     VEC (4);
 };
 
-struct Mat4
+struct alignas (16) Mat4
 {
     float data[4][4];
 
@@ -193,8 +211,25 @@ struct Mat4
 
         return data[i];
     }
+
+    const float* operator[] (uint i) const
+    {
+        assert (i < 4);
+
+        return data[i];
+    }
 };
 
+static_assert (std::is_trivially_copyable<Vec2>::value
+                   && std::is_trivially_copyable<Vec3>::value
+                   && std::is_trivially_copyable<Vec4>::value
+                   && std::is_trivially_copyable<Mat4>::value,
+               "math types must stay memcpy-able");
+
+static_assert (sizeof (Vec2) == 2 * sizeof (float)
+                   && sizeof (Vec4) == 4 * sizeof (float),
+               "math types must stay their payload size");
+
 Mat4 identity ()
 {
     return {
@@ -205,10 +240,8 @@ Mat4 identity ()
     };
 }
 
-Mat4 ortho (float W, float H)
+Mat4 ortho (float l, float r, float t, float b)
 {
-    float r = W, t = 0;
-    float l = 0, b = H;
     float f = 1, n = -1;
 
     Mat4 matrix = identity ();
@@ -225,10 +258,32 @@ Mat4 ortho (float W, float H)
     return matrix;
 }
 
-inline Mat4 mul (Mat4 m1, Mat4 m2)
+Mat4 ortho (float W, float H) { return ortho (0, W, 0, H); }
+
+inline Mat4 mul (const Mat4& m1, const Mat4& m2)
 {
     Mat4 result;
 
+#ifdef __SSE__
+    // each result row is the rows of m2 weighted by that row of m1
+    __m128 rows[4];
+
+    for (int k = 0; k < 4; k++) rows[k] = _mm_load_ps (m2.data[k]);
+
+    for (int i = 0; i < 4; i++)
+    {
+        __m128 row = _mm_mul_ps (_mm_set1_ps (m1.data[i][0]), rows[0]);
+
+        for (int k = 1; k < 4; k++)
+        {
+            __m128 weight = _mm_set1_ps (m1.data[i][k]);
+
+            row = _mm_add_ps (row, _mm_mul_ps (weight, rows[k]));
+        }
+
+        _mm_store_ps (result.data[i], row);
+    }
+#else
     for (int i = 0; i < 4; i++)
     {
         for (int j = 0; j < 4; j++)
@@ -240,6 +295,7 @@ inline Mat4 mul (Mat4 m1, Mat4 m2)
             result[i][j] = val;
         }
     }
+#endif
 
     return result;
 }
@@ -294,18 +350,37 @@ inline void rotate (Mat4& matrix, float angle)
     matrix = mul (matrix, rotation_matrix);
 }
 
+// translate (pos + size / 2) * rotate * translate (-size / 2) * scale,
+// written out instead of multiplied
 inline Mat4 get_model (Vec2 pos, Vec2 size, float angle = 0, bool center = true)
 {
-    Mat4 matrix = identity ();
+    float c = 1, s = 0;
+
+    if (angle != 0)
+    {
+        angle = angle * (3.1415f / 180.f);
+
+        c = cosf (angle);
+        s = sinf (angle);
+    }
+
+    Vec2 half = size * 0.5f;
+    Vec2 pivot;
 
-    translate (matrix, pos);
-    translate (matrix, size * (0.5f));
+    if (center) pivot = { c * half.x - s * half.y, s * half.x + c * half.y };
 
-    rotate (matrix, angle);
+    Mat4 matrix;
 
-    if (center) translate (matrix, size * (-0.5f));
+    matrix[0][0] = c * size.x;
+    matrix[0][1] = -s * size.y;
+    matrix[0][3] = pos.x + half.x - pivot.x;
 
-    scale (matrix, size);
+    matrix[1][0] = s * size.x;
+    matrix[1][1] = c * size.y;
+    matrix[1][3] = pos.y + half.y - pivot.y;
+
+    matrix[2][2] = 1;
+    matrix[3][3] = 1;
 
     return matrix;
 }
@@ -435,8 +510,20 @@ template <class T> struct List
     }
 };
 
+// Growable buffer. Elements that are trivially copyable (everything the
+// tree and the renderer store) move with realloc, so growing is a single
+// memcpy at worst and often free; anything else is move-assigned into a
+// new[] buffer. Types aligned wider than malloc's guarantee, the B-tree's
+// line-sized nodes, are copied into an aligned block instead. operator[]
+// is unchecked, at() clamps like it used to
 template <class T> struct Array
 {
+    static const bool TRIVIAL = std::is_trivially_copyable<T>::value;
+    static const bool ALIGNED = alignof (T) > alignof (std::max_align_t);
+
+    static_assert (TRIVIAL || !ALIGNED,
+                   "over-aligned elements must be trivially copyable");
+
     T*     data;
     size_t length, size;
 
@@ -460,480 +547,6255 @@ template <class T> struct Array
         push (args...);
     }
 
-    void resize ()
+    void reserve (size_t capacity)
     {
-        if (size == 0)
-        {
-            data = new T[1];
-            size = 1;
-        }
-        else if (length >= size) {
-            T* new_data = new T[size *= 2];
+        if (capacity <= size) return;
 
-            for (size_t i = 0; i < length; i++) new_data[i] = data[i];
+        reserve (capacity, std::integral_constant<bool, ALIGNED> ());
 
-            delete data;
+        size = capacity;
+    }
 
-            data = new_data;
-        }
+    // An overload rather than a branch, so new[] is never instantiated
+    // for a type it can't align
+    void reserve (size_t capacity, std::true_type)
+    {
+        void* grown = nullptr;
+
+#ifndef _WIN32
+        if (posix_memalign (&grown, alignof (T), capacity * sizeof (T)))
+            grown = nullptr;
+#else
+        grown = _aligned_malloc (capacity * sizeof (T), alignof (T));
+#endif
+        assert (grown != nullptr);
+
+        if (length) memcpy (grown, (void*)data, length * sizeof (T));
+
+        release ();
+
+        data = (T*)grown;
     }
 
-    T& push (T value)
+    void reserve (size_t capacity, std::false_type)
     {
-        resize ();
+        if (TRIVIAL)
+        {
+            T* grown = (T*)realloc ((void*)data, capacity * sizeof (T));
+
+            assert (grown != nullptr);
+
+            data = grown;
+        }
+        else {
+            T* grown = new T[capacity];
 
-        data[length++] = value;
+            for (size_t i = 0; i < length; i++) grown[i] = std::move (data[i]);
 
-        return data[length - 1];
+            delete[] data;
+
+            data = grown;
+        }
     }
 
-    T& operator[] (size_t index)
+    void grow ()
     {
-        return (index >= length) ? data[length - 1] : data[index];
+        if (length == size) reserve (size ? size * 2 : 8);
     }
 
-    void clean ()
+    T& push (const T& value)
     {
-        if (data) delete data;
+        if (length == size)
+        {
+            T copy = value;    // value may live in the buffer being moved
 
-        data = nullptr;
+            grow ();
 
-        length = size = 0;
+            data[length] = std::move (copy);
+        }
+        else data[length] = value;
+
+        return data[length++];
     }
-};
 
-template <class T> struct Tree
-{
-    struct Node
+    T& push (T&& value)
     {
-        T     data;
-        int   weight;
-        Node *left, *right;
-
-        Node (T data, Node* left = nullptr, Node* right = nullptr)
+        if (length == size)
         {
-            this->data  = data;
-            this->left  = left;
-            this->right = right;
-        }
-    };
+            T copy = std::move (value);
 
-    Node* root;
+            grow ();
 
-    Tree () { root = nullptr; }
+            data[length] = std::move (copy);
+        }
+        else data[length] = std::move (value);
 
-    template <class... Args> Tree (T val, Args... args)
-    {
-        root = nullptr;
-        push (val, args...);
+        return data[length++];
     }
 
-    template <class... Args> void push (T data, Args... args)
+    // Builds the element in place from constructor arguments
+    template <class... Args> T& emplace (Args&&... args)
     {
-        root = push (data, root);
-        push (args...);
+        grow ();
+
+        if (TRIVIAL) new (&data[length]) T (std::forward<Args> (args)...);
+        else data[length] = T (std::forward<Args> (args)...);
+
+        return data[length++];
     }
 
-    Node* push (T data, Node* leaf)
-    {
-        if (!leaf) return new Node (data);
+    T& operator[] (size_t index) { return data[index]; }
 
-        if (data < leaf->data) leaf->left = push (data, leaf->left);
-        else leaf->right = push (data, leaf->right);
+    const T& operator[] (size_t index) const { return data[index]; }
 
-        return leaf;
+    // Checked: an index past the end gives the last element
+    T& at (size_t index)
+    {
+        return (index >= length) ? data[length - 1] : data[index];
     }
 
-    void push (T data) { root = push (data, root); }
+    T& back () { return data[length - 1]; }
 
-    void push (Array<T> data)
+    T pop () { return data[--length]; }
+
+    T* begin () { return data; }
+    T* end () { return data + length; }
+
+    const T* begin () const { return data; }
+    const T* end () const { return data + length; }
+
+    void release ()
     {
-        for (size_t i = 0; i < data.length; i++) push (data[i]);
+#ifdef _WIN32
+        if (ALIGNED) _aligned_free ((void*)data);
+        else
+#endif
+        if (TRIVIAL) free ((void*)data);
+        else delete[] data;
     }
 
-    static int height (Node* node, int i)
+    void clean ()
     {
-        if (!node) return i - 1;
+        release ();
 
-        if (height (node->left, i + 1) > height (node->right, i + 1))
-            return height (node->left, i + 1);
-        else return height (node->right, i + 1);
-    }
+        data = nullptr;
 
-    int height () { return height (root, 1); }
-    int height (Node* node) { return height (node, 1); }
+        length = size = 0;
+    }
 };
 
-void print (Tree<int>::Node* node)
+namespace balance
 {
-    if (!node) return;
+    // Rotations work on arena indices, slot 0 is the tree's nil sentinel
 
-    printf ("%d\n", node->data);
-
-    print (node->left);
-    print (node->right);
-}
+    template <class Tr> void update (Tr& tree, uint32_t node)
+    {
+        typename Tr::Node& n = tree[node];
 
-struct string : public Array<char>
-{
-    char* c_str_data;
+        uint32_t l = tree[n.left].height, r = tree[n.right].height;
 
-    string () { c_str_data = nullptr; }
+        n.height = (l > r ? l : r) + 1;
+        n.weight = tree[n.left].weight + tree[n.right].weight + 1;
+        n.min    = n.left ? tree[n.left].min : n.data;
+        n.max    = n.right ? tree[n.right].max : n.data;
+        n.dirty  = true;
+    }
 
-    string (const char* str)
+    template <class Tr> uint32_t rotate_left (Tr& tree, uint32_t node)
     {
-        c_str_data = nullptr;
+        uint32_t right    = tree[node].right;
+        tree[node].right  = tree[right].left;
+        tree[right].left  = node;
+
+        update (tree, node);
+        update (tree, right);
 
-        for (int i = 0; str[i] != '\0'; i++) push (str[i]);
+        return right;
     }
 
-    string (size_t size)
+    template <class Tr> uint32_t rotate_right (Tr& tree, uint32_t node)
     {
-        c_str_data = nullptr;
+        uint32_t left     = tree[node].left;
+        tree[node].left   = tree[left].right;
+        tree[left].right  = node;
 
-        this->size = size;
-        data       = new char[size];
-    }
+        update (tree, node);
+        update (tree, left);
 
-    void clean ()
-    {
-        if (c_str_data) delete c_str_data;
-        if (data) delete data;
+        return left;
     }
 
-    char* c_str ()
+    // Removes one node holding `key`, which the caller made sure exists. A
+    // node with two children takes its successor's key and the successor
+    // goes instead; `removed` is the slot that left the tree. Policy::fix
+    // runs on the way back up, enough for the unbalanced and AVL trees
+    template <class Policy, class Tr, class K>
+    uint32_t unlink (Tr& tree, uint32_t root, const K& key, uint32_t& removed)
     {
-        if (c_str_data != nullptr) free (c_str_data);
+        auto&    path = tree.path;
+        uint32_t node = root;
+
+        path.length = 0;
 
-        c_str_data = new char[length + 1];
+        while (node)
+        {
+            path.push (node);
 
-        size_t i = 0;
+            if (key < tree[node].data) node = tree[node].left;
+            else if (tree[node].data < key) node = tree[node].right;
+            else break;
+        }
 
-        for (; i < length; i++) c_str_data[i] = this->data[i];
+        uint32_t target = node;
 
-        c_str_data[i] = '\0';
+        if (tree[node].left && tree[node].right)
+        {
+            for (target = tree[node].right; target; target = tree[target].left)
+                path.push (target);
 
-        return c_str_data;
-    }
+            target          = path.pop ();
+            tree[node].data = tree[target].data;
+        }
+        else path.pop ();
 
-    inline bool operator< (string b)
-    {
-        assert (b.length > 0 && length > 0);
+        uint32_t child = tree[target].left ? tree[target].left
+                                           : tree[target].right;
+        uint32_t old   = target;
 
-        for (size_t i = 0; i < length && i < b.length; i++)
+        removed = target;
+
+        for (size_t i = path.length; i-- > 0;)
         {
-            if (data[i] < b[i]) return true;
-            else if (data[i] > b[i]) return false;
+            uint32_t parent = path.data[i];
+
+            if (tree[parent].left == old) tree[parent].left = child;
+            else tree[parent].right = child;
+
+            update (tree, parent);
+
+            old   = parent;
+            child = Policy::fix (tree, parent);
         }
 
-        return false;
+        return child;
     }
 
-    inline bool operator> (string b) { return b < (*this); }
-
-    inline bool operator== (string b)
+    // Plain BST, the shape follows the input order
+    struct None
     {
-        assert (b.length > 0 && length > 0);
+        template <class Tr> static uint32_t fix (Tr& tree, uint32_t node)
+        {
+            return node;
+        }
+
+        template <class Tr, class K>
+        static uint32_t erase (Tr& tree, uint32_t root, const K& key,
+                               uint32_t& removed)
+        {
+            return unlink<None> (tree, root, key, removed);
+        }
 
-        if (b.length != length) return false;
+        template <class Tr> static void root (Tr& tree, uint32_t node) { }
+    };
 
-        for (size_t i = 0; i < length; i++)
+    // Subtree heights differ by at most one
+    struct AVL
+    {
+        template <class Tr> static int factor (Tr& tree, uint32_t node)
         {
-            if (data[i] != b[i]) return false;
+            return (int)tree[tree[node].left].height
+                   - (int)tree[tree[node].right].height;
         }
 
-        return true;
-    }
-};
+        template <class Tr> static uint32_t fix (Tr& tree, uint32_t node)
+        {
+            int balance = factor (tree, node);
 
-string read_file (const char* filename)
-{
-    FILE* fp = fopen (filename, "r");
+            if (balance > 1)
+            {
+                if (factor (tree, tree[node].left) < 0)
+                    tree[node].left = rotate_left (tree, tree[node].left);
 
-    assert (fp != nullptr);
+                return rotate_right (tree, node);
+            }
+            else if (balance < -1) {
+                if (factor (tree, tree[node].right) > 0)
+                    tree[node].right = rotate_right (tree, tree[node].right);
 
-    fseek (fp, 0, SEEK_END);
-    size_t size = ftell (fp);
+                return rotate_left (tree, node);
+            }
 
-    fseek (fp, 0, SEEK_SET);
+            return node;
+        }
 
-    string str (size);
+        template <class Tr, class K>
+        static uint32_t erase (Tr& tree, uint32_t root, const K& key,
+                               uint32_t& removed)
+        {
+            return unlink<AVL> (tree, root, key, removed);
+        }
 
-    char c = '0';
+        template <class Tr> static void root (Tr& tree, uint32_t node) { }
+    };
 
-    while ((c = fgetc (fp)) != EOF) str.push (c);
+    // Left-leaning red-black tree, fixed up on the way back from the insert
+    struct RedBlack
+    {
+        template <class Tr> static bool red (Tr& tree, uint32_t node)
+        {
+            return tree[node].red;
+        }
 
-    fclose (fp);
+        // The node that moves up takes the old color, the one below goes red
+        template <class Tr>
+        static uint32_t recolor (Tr& tree, uint32_t node, uint32_t top)
+        {
+            tree[top].red  = tree[node].red;
+            tree[node].red = true;
 
-    return str;
-}
+            return top;
+        }
 
-const float W = 1280.f;
-const float H = 720.f;
+        template <class Tr> static uint32_t fix (Tr& tree, uint32_t node)
+        {
+            if (red (tree, tree[node].right) && !red (tree, tree[node].left))
+                node = recolor (tree, node, rotate_left (tree, node));
 
-struct Shader
-{
-    uint vao, vbo;
-    sint id, vertex, fragment;
+            if (red (tree, tree[node].left)
+                && red (tree, tree[tree[node].left].left))
+                node = recolor (tree, node, rotate_right (tree, node));
 
-    Shader () { id = vertex = fragment = vbo = vao = 0; }
+            if (red (tree, tree[node].left) && red (tree, tree[node].right))
+                flip (tree, node);
 
-    Shader (const char* vs_file, const char* fs_file)
-    {
-        init (vs_file, fs_file);
-    }
+            return node;
+        }
 
-    void set (const char* name, sint val)
-    {
-        glUniform1i (glGetUniformLocation (id, name), val);
-    }
+        // Nil children keep their color, the sentinel has to stay black
+        template <class Tr> static void flip (Tr& tree, uint32_t node)
+        {
+            uint32_t left = tree[node].left, right = tree[node].right;
 
-    void set (const char* name, float val)
-    {
-        glUniform1f (glGetUniformLocation (id, name), val);
-    }
+            tree[node].red = !tree[node].red;
 
-    void set (const char* name, Vec3 val)
-    {
-        glUniform3fv (glGetUniformLocation (id, name), 1, val.data);
-    }
+            if (left) tree[left].red = !tree[left].red;
+            if (right) tree[right].red = !tree[right].red;
+        }
 
-    void set (const char* name, Vec4 val)
-    {
-        glUniform4fv (glGetUniformLocation (id, name), 1, val.data);
-    }
+        // Deletion goes down with the current node or one of its children
+        // red, borrowing from the sibling side, so the node that finally
+        // comes off the bottom is red and no black height changes
+        template <class Tr>
+        static uint32_t move_red_left (Tr& tree, uint32_t node)
+        {
+            flip (tree, node);
 
-    void set (const char* name, Vec2 val)
-    {
-        glUniform2fv (glGetUniformLocation (id, name), 1, val.data);
-    }
+            uint32_t right = tree[node].right;
 
-    void set (const char* name, Mat4 val)
-    {
-        glUniformMatrix4fv (glGetUniformLocation (id, name), 1, GL_TRUE,
-                            val[0]);
-    }
+            if (red (tree, tree[right].left))
+            {
+                tree[node].right
+                    = recolor (tree, right, rotate_right (tree, right));
 
-    sint compile (string code, uint type)
-    {
-        char* cstr   = code.c_str ();
-        sint  shader = glCreateShader (type), is_compiled = 0;
+                node = recolor (tree, node, rotate_left (tree, node));
 
-        glShaderSource (shader, 1, &cstr, 0);
-        glCompileShader (shader);
-        glGetShaderiv (shader, GL_COMPILE_STATUS, &is_compiled);
+                flip (tree, node);
+            }
 
-        if (is_compiled == GL_FALSE)
+            return node;
+        }
+
+        template <class Tr>
+        static uint32_t move_red_right (Tr& tree, uint32_t node)
         {
-            char info_log[512];
-            sint max_length = 0;
+            flip (tree, node);
 
-            glGetShaderiv (shader, GL_INFO_LOG_LENGTH, &max_length);
-            glGetShaderInfoLog (shader, max_length, &max_length, &info_log[0]);
+            if (red (tree, tree[tree[node].left].left))
+            {
+                node = recolor (tree, node, rotate_right (tree, node));
 
-            glDeleteShader (shader);
+                flip (tree, node);
+            }
 
-            assert (is_compiled != GL_FALSE);
+            return node;
         }
 
-        code.clean ();
+        template <class Tr>
+        static uint32_t erase_min (Tr& tree, uint32_t node, uint32_t& removed)
+        {
+            if (!tree[node].left)
+            {
+                removed = node;
+                return tree[node].right;
+            }
 
-        return shader;
-    }
+            if (!red (tree, tree[node].left)
+                && !red (tree, tree[tree[node].left].left))
+                node = move_red_left (tree, node);
 
-    void init (const char* vs_file, const char* fs_file)
-    {
-        vertex   = compile (read_file (vs_file), GL_VERTEX_SHADER);
-        fragment = compile (read_file (fs_file), GL_FRAGMENT_SHADER);
+            tree[node].left = erase_min (tree, tree[node].left, removed);
 
-        id = glCreateProgram ();
+            update (tree, node);
 
-        glAttachShader (id, vertex);
-        glAttachShader (id, fragment);
+            return fix (tree, node);
+        }
+
+        // Recursive, the depth is bounded by twice the black height
+        template <class Tr, class K>
+        static uint32_t erase_at (Tr& tree, uint32_t node, const K& key,
+                                  uint32_t& removed)
+        {
+            if (key < tree[node].data)
+            {
+                if (!red (tree, tree[node].left)
+                    && !red (tree, tree[tree[node].left].left))
+                    node = move_red_left (tree, node);
 
-        glLinkProgram (id);
+                tree[node].left
+                    = erase_at (tree, tree[node].left, key, removed);
+            }
+            else {
+                if (red (tree, tree[node].left))
+                    node = recolor (tree, node, rotate_right (tree, node));
+
+                bool found = !(tree[node].data < key);
+
+                if (found && !tree[node].right)
+                {
+                    removed = node;
+                    return tree[node].left;
+                }
+
+                // With duplicates the left child lifted by a rotation can
+                // match too, but only the node we borrowed for can go
+                // without unbalancing, so keep looking on the right
+                uint32_t top = node;
+
+                if (!red (tree, tree[node].right)
+                    && !red (tree, tree[tree[node].right].left))
+                    node = move_red_right (tree, node);
+
+                if (found && node == top)
+                {
+                    uint32_t next = tree[node].right;
+
+                    while (tree[next].left) next = tree[next].left;
+
+                    tree[node].data  = tree[next].data;
+                    tree[node].right
+                        = erase_min (tree, tree[node].right, removed);
+                }
+                else
+                    tree[node].right
+                        = erase_at (tree, tree[node].right, key, removed);
+            }
 
-        sint is_linked;
-        glGetProgramiv (id, GL_LINK_STATUS, &is_linked);
+            update (tree, node);
 
-        assert (is_linked != false);
+            return fix (tree, node);
+        }
 
-        glUseProgram (id);
-        set ("u_color", { 1, 1, 0 });
-        set ("u_projection", ortho (W, H));
+        template <class Tr, class K>
+        static uint32_t erase (Tr& tree, uint32_t root, const K& key,
+                               uint32_t& removed)
+        {
+            if (!red (tree, tree[root].left) && !red (tree, tree[root].right))
+                tree[root].red = true;
 
-        set ("u_image", 0);
-        set ("u_offset", { 0, 0, .1, .1 });
-        set ("u_alpha", 1.f);
+            return erase_at (tree, root, key, removed);
+        }
 
-        init_buffers ();
-    }
+        template <class Tr> static void root (Tr& tree, uint32_t node)
+        {
+            tree[node].red = false;
+            tree[0].red    = false;
+        }
+    };
+}
 
-    void init_buffers ()
+template <class T> struct Frozen;
+
+// Pre-order walk for trees that compute their links, asking tree.left (i)
+// and tree.right (i) for the children. Same contract as Tree::preorder
+template <class Tr, class S, class F>
+void preorder (Tr& tree, uint32_t node, S state, F visit)
+{
+    struct Frame
     {
-        const float points[] = {
-            0.0f, 1.0f,    //
-            1.0f, 0.0f,    //
-            0.0f, 0.0f,    //
+        uint32_t node;
+        S        state;
+    };
+
+    if (!node) return;
+
+    Array<Frame> stack;
+
+    stack.push ({ node, state });
+
+    while (stack.length)
+    {
+        Frame frame = stack.pop ();
+        S     left = frame.state, right = frame.state;
+
+        if (!visit (frame.node, frame.state, left, right)) continue;
+
+        if (tree.right (frame.node))
+            stack.push ({ tree.right (frame.node), right });
+        if (tree.left (frame.node))
+            stack.push ({ tree.left (frame.node), left });
+    }
+
+    stack.clean ();
+}
+
+// Nodes live in one contiguous pool and link to each other by 32-bit index.
+// Slot 0 is a nil sentinel with zero height and weight, so children can be
+// read without checking for null first. Like Array, the tree copies keys
+// shallowly and doesn't own them: a key holding heap memory, such as a
+// string past string::SMALL characters, is freed by whoever made it
+template <class T, class Balance = balance::None> struct Tree
+{
+    typedef uint32_t Index;
+
+    struct Node
+    {
+        T        data;
+        T        min, max;        // smallest and largest key in the subtree
+        uint32_t weight;          // subtree size, kept on insert
+        uint32_t height : 30;     // subtree levels
+        uint32_t red : 1;         // only read by balance::RedBlack
+        uint32_t dirty : 1;       // touched since the last layout
+        Index    left, right;
+
+        Node () { }
+
+        Node (T data, Index left = 0, Index right = 0)
+        {
+            this->data  = data;
+            this->left  = left;
+            this->right = right;
+
+            min = max = data;
+
+            weight = height = 1;
+            red = dirty = true;
+        }
+    };
+
+    Array<Node>  pool;
+    Index        root;
+    Array<Index> path;       // scratch for push and erase
+    Array<Index> freed;      // erased slots, reused by push
+    bool         changed;    // mutated since the last layout
+
+    Tree () { init (); }
+
+    template <class... Args> Tree (T val, Args... args)
+    {
+        init ();
+        push (val, args...);
+    }
+
+    void init ()
+    {
+        pool  = Array<Node> ();
+        path  = Array<Index> ();
+        freed = Array<Index> ();
+        root  = 0;
+
+        changed = true;
+
+        Node nil;
+
+        nil.weight = nil.height = nil.red = nil.dirty = 0;
+        nil.left = nil.right = 0;
+
+        pool.push (nil);
+    }
+
+    Node& operator[] (Index node) { return pool.data[node]; }
+
+    template <class... Args> void push (T data, Args... args)
+    {
+        push (data);
+        push (args...);
+    }
+
+    // Walks down to the leaf keeping the path on the heap, then rebalances
+    // on the way back up, so the call stack stays flat whatever the depth
+    void push (T data)
+    {
+        Index node = root;
+
+        path.length = 0;
+
+        while (node)
+        {
+            path.push (node);
+
+            if (data < pool.data[node].data) node = pool.data[node].left;
+            else node = pool.data[node].right;
+        }
+
+        Index child;
+
+        if (freed.length)
+        {
+            child            = freed.pop ();
+            pool.data[child] = Node (data);
+        }
+        else {
+            pool.push (Node (data));
+            child = pool.length - 1;
+        }
+
+        for (size_t i = path.length; i-- > 0;)
+        {
+            Index parent = path.data[i];
+
+            if (data < pool.data[parent].data) pool.data[parent].left = child;
+            else pool.data[parent].right = child;
+
+            balance::update (*this, parent);
+
+            child = Balance::fix (*this, parent);
+        }
+
+        root    = child;
+        changed = true;
+
+        Balance::root (*this, root);
+    }
+
+    void push (Array<T> data)
+    {
+        pool.reserve (pool.length + data.length);
+
+        for (size_t i = 0; i < data.length; i++) push (data[i]);
+    }
+
+    // Slot of a node holding `key`, nil when there is none
+    Index find (const T& key)
+    {
+        Index node = root;
+
+        while (node)
+        {
+            Node& n = pool.data[node];
+
+            if (key < n.data) node = n.left;
+            else if (n.data < key) node = n.right;
+            else break;
+        }
+
+        return node;
+    }
+
+    // Removes one occurrence of `key`. The freed slot is left out of the
+    // tree with zero weight and handed to the next push
+    bool erase (const T& key)
+    {
+        if (!find (key)) return false;
+
+        Index removed = 0;
+
+        root = Balance::erase (*this, root, key, removed);
+
+        Node& dead = pool.data[removed];
+
+        dead.left = dead.right = 0;
+        dead.weight = dead.height = 0;
+
+        freed.push (removed);
+
+        changed = true;
+
+        Balance::root (*this, root);
+
+        return true;
+    }
+
+    // The order statistics below walk one root-to-leaf path and read the
+    // subtree weights beside it
+
+    // Keys less than `key`, or not greater than it when `inclusive`
+    uint32_t rank (const T& key, bool inclusive = false)
+    {
+        uint32_t count = 0;
+        Index    node  = root;
+
+        while (node)
+        {
+            Node& n = pool.data[node];
+
+            if (inclusive ? key < n.data : !(n.data < key)) node = n.left;
+            else {
+                count += pool.data[n.left].weight + 1;
+                node = n.right;
+            }
+        }
+
+        return count;
+    }
+
+    // Slot of the k-th smallest key counting from 0, nil past the end
+    Index select (uint32_t k)
+    {
+        Index node = root;
+
+        while (node)
+        {
+            uint32_t left = pool.data[pool.data[node].left].weight;
+
+            if (k == left) break;
+
+            if (k < left) node = pool.data[node].left;
+            else {
+                k -= left + 1;
+                node = pool.data[node].right;
+            }
+        }
+
+        return node;
+    }
+
+    // Keys in [lo, hi]
+    uint32_t count_range (const T& lo, const T& hi)
+    {
+        return hi < lo ? 0 : rank (hi, true) - rank (lo);
+    }
+
+    // In-order, holding the left spine still to be visited
+    struct iterator
+    {
+        Tree*        tree;
+        Array<Index> stack;
+
+        iterator (Tree* tree) : tree (tree) { }
+
+        iterator (const iterator& b) : tree (b.tree)
+        {
+            for (Index node : b.stack) stack.push (node);
+        }
+
+        ~iterator () { stack.clean (); }
+
+        iterator& operator= (const iterator& b) = delete;
+
+        void descend (Index node)
+        {
+            for (; node; node = (*tree)[node].left) stack.push (node);
+        }
+
+        Index index () const
+        {
+            return stack.length ? stack.data[stack.length - 1] : 0;
+        }
+
+        T& operator* () { return (*tree)[index ()].data; }
+
+        iterator& operator++ ()
+        {
+            descend ((*tree)[stack.pop ()].right);
+
+            return *this;
+        }
+
+        bool operator!= (const iterator& b) const
+        {
+            return index () != b.index ();
+        }
+    };
+
+    iterator begin ()
+    {
+        iterator it (this);
+
+        it.descend (root);
+
+        return it;
+    }
+
+    iterator end () { return iterator (this); }
+
+    // From the first key not less than `key`
+    iterator lower_bound (const T& key)
+    {
+        iterator it (this);
+
+        for (Index node = root; node;)
+        {
+            if (pool.data[node].data < key) node = pool.data[node].right;
+            else {
+                it.stack.push (node);
+                node = pool.data[node].left;
+            }
+        }
+
+        return it;
+    }
+
+    // Sorts with up to `threads` workers: halves are sorted side by side
+    // and merged in place on the way back
+    static void sort (T* data, size_t length, int threads)
+    {
+        if (threads < 2 || length < 1 << 16)
+        {
+            std::sort (data, data + length);
+            return;
+        }
+
+        size_t      half = length / 2;
+        std::thread worker (sort, data, half, threads / 2);
+
+        sort (data + half, length - half, threads - threads / 2);
+
+        worker.join ();
+
+        std::inplace_merge (data, data + half, data + length);
+    }
+
+    // Size of the left subtree of a complete tree of `length` nodes, so the
+    // last level fills from the left
+    static size_t left_length (size_t length)
+    {
+        if (length <= 1) return 0;
+
+        size_t full = 1;
+
+        while (full * 2 <= length) full *= 2;
+
+        size_t half = full / 2, bottom = length - (full - 1);
+
+        return (half - 1) + (bottom < half ? bottom : half);
+    }
+
+    // Builds sorted keys into pool slots [index, index + length), laid out
+    // in pre-order. Both halves know their slots up front, so they can be
+    // built by different threads without locking
+    Index build (const T* keys, size_t length, Index index, int depth,
+                 int red_depth, int threads)
+    {
+        if (length == 0) return 0;
+
+        size_t left = left_length (length);
+
+        Node& node = pool.data[index];
+
+        node = Node (keys[left]);
+
+        node.red = (depth == red_depth);
+
+        if (threads > 1 && length > 1 << 16)
+        {
+            Index       l = 0;
+            std::thread worker ([&] () {
+                l = build (keys, left, index + 1, depth + 1, red_depth,
+                           threads / 2);
+            });
+
+            node.right = build (keys + left + 1, length - left - 1,
+                                index + 1 + left, depth + 1, red_depth,
+                                threads - threads / 2);
+
+            worker.join ();
+
+            node.left = l;
+        }
+        else {
+            node.left  = build (keys, left, index + 1, depth + 1, red_depth, 1);
+            node.right = build (keys + left + 1, length - left - 1,
+                                index + 1 + left, depth + 1, red_depth, 1);
+        }
+
+        balance::update (*this, index);
+
+        return Balance::fix (*this, index);
+    }
+
+    // Replaces the tree with a complete, perfectly balanced one in O(n)
+    // after the sort (skipped when the keys already come sorted). Nodes on
+    // an unfilled last level start red and every other one black, the
+    // policy's fix then settles each subtree as it would after a push
+    void build (Array<T> data, int threads = 0)
+    {
+        if (threads <= 0) threads = std::thread::hardware_concurrency ();
+        if (threads <= 0) threads = 1;
+
+        T* keys = new T[data.length];
+
+        for (size_t i = 0; i < data.length; i++) keys[i] = data.data[i];
+
+        if (!std::is_sorted (keys, keys + data.length))
+            sort (keys, data.length, threads);
+
+        pool.clean ();
+        path.clean ();
+        freed.clean ();
+        init ();
+
+        pool.reserve (data.length + 1);
+        pool.length = data.length + 1;
+
+        int levels = 0;
+
+        while ((size_t)1 << (levels + 1) <= data.length) levels++;
+
+        bool perfect = (data.length + 1) == (size_t)1 << (levels + 1);
+
+        root = build (keys, data.length, 1, 0, perfect ? -1 : levels, threads);
+
+        Balance::root (*this, root);
+
+        delete[] keys;
+    }
+
+    // Traversals run on an explicit stack bounded by the subtree height
+
+    // visit (node, state, left, right): state was handed down by the
+    // parent, left and right start as copies of it and go to the children.
+    // Returning false skips the subtree
+    template <class S, class F> void preorder (Index node, S state, F visit)
+    {
+        struct Frame
+        {
+            Index node;
+            S     state;
+        };
+
+        if (!node) return;
+
+        Array<Frame> stack;
+
+        stack.reserve (height (node) + 1);
+        stack.push ({ node, state });
+
+        while (stack.length)
+        {
+            Frame frame = stack.pop ();
+            Node& n     = pool.data[frame.node];
+            S     left = frame.state, right = frame.state;
+
+            if (!visit (frame.node, frame.state, left, right)) continue;
+
+            if (n.right) stack.push ({ n.right, right });
+            if (n.left) stack.push ({ n.left, left });
+        }
+
+        stack.clean ();
+    }
+
+    template <class F> void preorder (Index node, F visit)
+    {
+        preorder (node, 0, [&] (Index index, int, int&, int&) -> bool {
+            return visit (index);
+        });
+    }
+
+    template <class F> void inorder (Index node, F visit)
+    {
+        Array<Index> stack;
+
+        stack.reserve (height (node) + 1);
+
+        while (node || stack.length)
+        {
+            for (; node; node = pool.data[node].left) stack.push (node);
+
+            node = stack.pop ();
+
+            visit (node);
+
+            node = pool.data[node].right;
+        }
+
+        stack.clean ();
+    }
+
+    template <class F> void postorder (Index node, F visit)
+    {
+        Array<Index> stack;
+        Index        last = 0;
+
+        stack.reserve (height (node) + 1);
+
+        while (node || stack.length)
+        {
+            for (; node; node = pool.data[node].left) stack.push (node);
+
+            Index top = stack.data[stack.length - 1];
+
+            if (pool.data[top].right && pool.data[top].right != last)
+                node = pool.data[top].right;
+            else {
+                visit (top);
+
+                last = stack.pop ();
+            }
+        }
+
+        stack.clean ();
+    }
+
+    // Frees every node at once, not what the keys point to
+    void clean ()
+    {
+        pool.clean ();
+        path.clean ();
+        freed.clean ();
+        init ();
+    }
+
+    // Rewrites the pool in pre-order, the order every traversal walks it
+    void compact ()
+    {
+        Array<Node> out;
+
+        out.reserve (size () + 1);
+        out.push (pool.data[0]);
+
+        // out never grows past its reserve, so links can be kept by address
+        preorder (root, &root, [&] (Index node, Index* link, Index*& left,
+                                    Index*& right) {
+            *link = out.length;
+
+            Node& copy = out.push (pool.data[node]);
+
+            copy.left = copy.right = 0;
+            copy.dirty             = true;
+
+            left  = &copy.left;
+            right = &copy.right;
+
+            return true;
+        });
+
+        pool.clean ();
+        pool = out;
+
+        freed.length = 0;
+        changed     = true;
+    }
+
+    int height (Index node) { return pool.data[node].height; }
+    int size (Index node) { return pool.data[node].weight; }
+
+    uint32_t weight (Index node) { return pool.data[node].weight; }
+
+    int height () { return height (root); }
+    int size () { return size (root); }
+
+    Index slots () { return pool.length; }
+
+    Frozen<T> freeze ()
+    {
+        Frozen<T> frozen;
+
+        frozen.freeze (*this);
+
+        return frozen;
+    }
+};
+
+// Read-only snapshot of a tree for sessions that load once and then only
+// look. Only the keys are kept, in Eytzinger order: the root sits at 1 and
+// the children of i at 2i and 2i + 1, so slot 0 is nil as in Tree and the
+// shape needs no links. A search reads keys[1], keys[2..3], keys[4..7]...,
+// the top levels share cache lines and the rest is prefetched ahead
+template <class T> struct Frozen
+{
+    typedef uint32_t Index;
+
+    // Keys per cache line; the slots log2 (LINE) levels below i start at
+    // i * LINE, which is what a search prefetches
+    static const size_t LINE = sizeof (T) < 64 ? 64 / sizeof (T) : 1;
+
+    // A slot the way Tree::Node describes it, worked out from the index
+    struct Node
+    {
+        T        data, min, max;
+        uint32_t weight;
+        bool     dirty;
+        Index    left, right;
+    };
+
+    Array<T>     keys;      // keys[0] is unused
+    Index        length;
+    Index        root;
+    Array<Index> freed;     // always empty, for layout
+    bool         changed;
+
+    Frozen () { init (); }
+
+    void init ()
+    {
+        keys  = Array<T> ();
+        freed = Array<Index> ();
+
+        length = root = 0;
+        changed       = true;
+    }
+
+    // The in-order walk of the tree fills the slots in in-order
+    template <class Tr> void freeze (Tr& tree)
+    {
+        clean ();
+
+        length = tree.size ();
+
+        keys.reserve (length + 1);
+        keys.length = length + 1;
+
+        Index slot = leftmost (length ? 1 : 0);
+
+        tree.inorder (tree.root, [&] (uint32_t node) {
+            keys.data[slot] = tree[node].data;
+
+            slot = next (slot);
+        });
+
+        root = length ? 1 : 0;
+    }
+
+    Index left (Index node)
+    {
+        return node && 2 * (uint64_t)node <= length ? 2 * node : 0;
+    }
+
+    Index right (Index node)
+    {
+        return node && 2 * (uint64_t)node + 1 <= length ? 2 * node + 1 : 0;
+    }
+
+    // The tree is complete, so the ends of a subtree are a shift away: the
+    // leftmost path doubles node, the rightmost doubles node + 1, each as
+    // far as length allows
+    Index leftmost (Index node)
+    {
+        return node ? node << (height (node) - 1) : 0;
+    }
+
+    Index rightmost (Index node)
+    {
+        if (!node) return 0;
+
+        int levels = 63 - __builtin_clzll ((length + 1ull) / (node + 1ull));
+
+        return (Index)(((node + 1ull) << levels) - 1);
+    }
+
+    // In-order successor, nil after the last slot
+    Index next (Index node)
+    {
+        if (right (node)) return leftmost (right (node));
+
+        while (node & 1) node >>= 1;    // out of the right subtrees
+
+        return node >> 1;
+    }
+
+    uint32_t weight (Index node) { return size (node); }
+
+    Node operator[] (Index node)
+    {
+        Node n;
+
+        n.data   = keys.data[node];
+        n.min    = keys.data[leftmost (node)];
+        n.max    = keys.data[rightmost (node)];
+        n.weight = size (node);
+        n.dirty  = true;
+        n.left   = left (node);
+        n.right  = right (node);
+
+        return n;
+    }
+
+    // Slot of the first key not less than `key`, nil when every key is
+    // less. The comparison picks the child instead of a branch, so each
+    // search runs the same steps; the path is then cut back past its
+    // trailing right turns to the last left turn, which is the answer
+    Index lower_bound (const T& key) const
+    {
+        const T* k = keys.data;
+        uint64_t i = 1;
+
+        while (i <= length)
+        {
+            __builtin_prefetch (k + i * LINE);
+
+            i = 2 * i + (k[i] < key);
+        }
+
+        return (Index)(i >> (__builtin_ctzll (~i) + 1));
+    }
+
+    Index find (const T& key) const
+    {
+        Index node = lower_bound (key);
+
+        return node && !(key < keys.data[node]) ? node : 0;
+    }
+
+    // Keys before `node` in order: its left subtree, plus each parent it
+    // is the right child of together with that parent's left subtree
+    uint32_t position (Index node)
+    {
+        uint32_t count = size (left (node));
+
+        for (; node > 1; node >>= 1)
+            if (node & 1) count += size (node - 1) + 1;
+
+        return count;
+    }
+
+    // Keys less than `key`
+    uint32_t rank (const T& key)
+    {
+        Index node = lower_bound (key);
+
+        return node ? position (node) : length;
+    }
+
+    // Slot of the k-th smallest key counting from 0, nil past the end
+    Index select (uint32_t k)
+    {
+        Index node = root;
+
+        while (node)
+        {
+            uint32_t before = size (left (node));
+
+            if (k == before) break;
+
+            if (k < before) node = left (node);
+            else {
+                k -= before + 1;
+                node = right (node);
+            }
+        }
+
+        return node;
+    }
+
+    // Traversals mirror Tree's, with the children computed
+
+    template <class S, class F> void preorder (Index node, S state, F visit)
+    {
+        ::preorder (*this, node, state, visit);
+    }
+
+    template <class F> void preorder (Index node, F visit)
+    {
+        preorder (node, 0, [&] (Index index, int, int&, int&) -> bool {
+            return visit (index);
+        });
+    }
+
+    template <class F> void inorder (Index node, F visit)
+    {
+        if (!node) return;
+
+        Index last = rightmost (node);
+
+        for (node = leftmost (node);; node = next (node))
+        {
+            visit (node);
+
+            if (node == last) break;
+        }
+    }
+
+    // The leftmost path is the longest, the tree is complete: node doubled
+    // levels - 1 times still fits in length
+    int height (Index node)
+    {
+        return node && node <= length ? 64 - __builtin_clzll (length / node)
+                                      : 0;
+    }
+
+    // Every level but the last is full, the last is a run of slots cut off
+    // at the end
+    uint32_t size (Index node)
+    {
+        int levels = height (node);
+
+        if (!levels) return 0;
+
+        uint64_t width = 1ull << (levels - 1);
+        uint64_t first = (uint64_t)node << (levels - 1);
+        uint64_t last  = first + width - 1;
+
+        if (last > length) last = length;
+
+        return (uint32_t)(width - 1 + last - first + 1);
+    }
+
+    int height () { return height (root); }
+    int size () { return size (root); }
+
+    Index slots () { return length + 1; }
+
+    void clean ()
+    {
+        keys.clean ();
+        freed.clean ();
+        init ();
+    }
+};
+
+// In-node search: how many of a node's sorted keys sort before `key`.
+// Nodes are a few cache lines, so a straight scan beats bisecting them
+namespace scan
+{
+    // Keys less than `key`
+    template <class T> int lower (const T* keys, int count, const T& key)
+    {
+        int i = 0;
+
+        while (i < count && keys[i] < key) i++;
+
+        return i;
+    }
+
+    // Keys not greater than `key`, where a duplicate goes
+    template <class T> int upper (const T* keys, int count, const T& key)
+    {
+        int i = 0;
+
+        while (i < count && !(key < keys[i])) i++;
+
+        return i;
+    }
+
+#ifdef __SSE__
+    // Four keys per compare. The keys are sorted, so the lanes that pass
+    // are a prefix and counting them is the position; lanes past count
+    // hold whatever the node left there and are masked off
+    inline int lower (const float* keys, int count, const float& key)
+    {
+        __m128   k    = _mm_set1_ps (key);
+        uint32_t mask = 0;
+
+        for (int i = 0; i < count; i += 4)
+            mask |= _mm_movemask_ps (_mm_cmplt_ps (_mm_loadu_ps (keys + i), k))
+                    << i;
+
+        return __builtin_popcount (mask & ((1u << count) - 1));
+    }
+
+    inline int upper (const float* keys, int count, const float& key)
+    {
+        __m128   k    = _mm_set1_ps (key);
+        uint32_t mask = 0;
+
+        for (int i = 0; i < count; i += 4)
+            mask |= _mm_movemask_ps (_mm_cmple_ps (_mm_loadu_ps (keys + i), k))
+                    << i;
+
+        return __builtin_popcount (mask & ((1u << count) - 1));
+    }
+#endif
+}
+
+// B-tree with nodes sized to cache lines: a float node's 15 keys and its
+// count fill one line and its 16 child links the next, and the pool keeps
+// nodes on line boundaries, so a lookup misses about once per level on a
+// tree a quarter as tall as the binary one. Subtree weights live apart in
+// `weights`, since only rank, select and the graphics code read them. Inserts
+// split full nodes on the way down and never walk back up.
+//
+// The root node stays in pool slot 1. For layout and culling the tree is
+// also seen as a binary tree over key slots, slot (node, j) for the j-th
+// key of a node: left is the child before the key, right is the next key
+// in the node or, after the last one, the last child. That view has the
+// keys in order and the interface Frozen has, so the graphics code that
+// walks a Tree walks it too
+template <class T> struct BTree
+{
+    typedef uint32_t Index;
+
+    static const int HALF = (64 / sizeof (T) > 4 ? 64 / sizeof (T) : 4) / 2;
+    static const int KEYS = 2 * HALF - 1;    // a full node splits in two
+
+    // count takes the spare key's place, so whole SIMD loads over the
+    // keys stay in the node and the mask drops what they read of it
+    struct alignas (64) Node
+    {
+        T                  keys[KEYS];
+        uint32_t           count;                 // keys in use
+        alignas (64) Index children[KEYS + 1];    // all nil in a leaf
+    };
+
+    // What a key slot looks like to the graphics code, see above
+    struct Slot
+    {
+        T        data, min, max;
+        uint32_t weight;
+        bool     dirty;
+        Index    left, right;
+    };
+
+    Array<Node>     pool;
+    Array<uint32_t> weights;    // keys in each node's subtree, by slot
+    Index           root;       // 1, or nil while empty
+    Array<Index>    freed;      // always empty, for layout
+    bool            changed;    // mutated since the last layout
+
+    BTree () { init (); }
+
+    void init ()
+    {
+        pool    = Array<Node> ();
+        weights = Array<uint32_t> ();
+        freed   = Array<Index> ();
+        root    = 0;
+
+        changed = true;
+
+        pool.push (Node ());
+        weights.push (0);
+    }
+
+    Index alloc ()
+    {
+        pool.push (Node ());
+        weights.push (0);
+
+        return pool.length - 1;
+    }
+
+    bool leaf (Index node) { return !pool.data[node].children[0]; }
+
+    Index find_node (const T& key, int& at)
+    {
+        for (Index node = root; node;)
+        {
+            Node& n = pool.data[node];
+            int   i = scan::lower (n.keys, n.count, key);
+
+            if (i < (int)n.count && !(key < n.keys[i]))
+            {
+                at = i;
+                return node;
+            }
+
+            node = n.children[i];
+        }
+
+        return 0;
+    }
+
+    // Key slot holding `key`, nil when there is none
+    Index find (const T& key)
+    {
+        int   at;
+        Index node = find_node (key, at);
+
+        return node ? slot (node, at) : 0;
+    }
+
+    // Moves the upper half of the full child i of `parent` to a new node
+    // and its median up into `parent`, which has room
+    void split (Index parent, int i)
+    {
+        Index right = alloc ();
+        Index left  = pool.data[parent].children[i];
+
+        Node &p = pool.data[parent], &l = pool.data[left],
+             &r = pool.data[right];
+
+        r.count = HALF - 1;
+
+        for (int j = 0; j < HALF - 1; j++) r.keys[j] = l.keys[j + HALF];
+
+        weights.data[right] = r.count;
+
+        if (l.children[0])
+        {
+            for (int j = 0; j < HALF; j++)
+            {
+                r.children[j] = l.children[j + HALF];
+                weights.data[right] += weights.data[r.children[j]];
+
+                l.children[j + HALF] = 0;
+            }
+        }
+
+        l.count = HALF - 1;
+        weights.data[left] -= weights.data[right] + 1;
+
+        for (int j = p.count; j > i; j--)
+        {
+            p.keys[j]         = p.keys[j - 1];
+            p.children[j + 1] = p.children[j];
+        }
+
+        p.keys[i]         = l.keys[HALF - 1];
+        p.children[i + 1] = right;
+        p.count++;
+    }
+
+    void push (T key)
+    {
+        if (!root) root = alloc ();
+
+        // A full root moves down a level so the split has a parent
+        if (pool.data[root].count == KEYS)
+        {
+            Index old = alloc ();
+
+            pool.data[old] = pool.data[root];
+            pool.data[root] = Node ();
+
+            pool.data[root].children[0] = old;
+            weights.data[old]           = weights.data[root];
+
+            split (root, 0);
+        }
+
+        for (Index node = root;;)
+        {
+            weights.data[node]++;
+
+            int i = scan::upper (pool.data[node].keys, pool.data[node].count,
+                                 key);
+
+            if (leaf (node))
+            {
+                Node& n = pool.data[node];
+
+                for (int j = n.count; j > i; j--) n.keys[j] = n.keys[j - 1];
+
+                n.keys[i] = key;
+                n.count++;
+                break;
+            }
+
+            if (pool.data[pool.data[node].children[i]].count == KEYS)
+            {
+                split (node, i);
+
+                if (!(key < pool.data[node].keys[i])) i++;
+            }
+
+            node = pool.data[node].children[i];
+        }
+
+        changed = true;
+    }
+
+    // Keys a subtree `levels` deep can hold: (KEYS + 1)^levels - 1
+    static uint64_t capacity (int levels)
+    {
+        uint64_t count = 1;
+
+        for (int i = 0; i < levels; i++) count *= KEYS + 1;
+
+        return count - 1;
+    }
+
+    // Fills a subtree from sorted keys with every leaf on the same level:
+    // as few children as hold the keys, the keys dealt out evenly with one
+    // separator between each pair. The recursion is as deep as the tree
+    Index build (const T* keys, size_t length, int levels)
+    {
+        Index node = alloc ();
+
+        weights.data[node] = length;
+
+        if (levels == 1)
+        {
+            for (size_t i = 0; i < length; i++)
+                pool.data[node].keys[i] = keys[i];
+
+            pool.data[node].count = length;
+
+            return node;
+        }
+
+        uint64_t below    = capacity (levels - 1);
+        size_t   children = (length + below + 1) / (below + 1);
+        size_t   rest     = length - (children - 1), at = 0;
+
+        for (size_t c = 0; c < children; c++)
+        {
+            size_t take = rest / children + (c < rest % children);
+
+            Index child = build (keys + at, take, levels - 1);
+
+            pool.data[node].children[c] = child;
+
+            at += take;
+
+            if (c + 1 < children) pool.data[node].keys[c] = keys[at++];
+        }
+
+        pool.data[node].count = children - 1;
+
+        return node;
+    }
+
+    // Bulk insert: sorts a copy of `data` unless it already is, then
+    // builds level by level instead of splitting
+    void build (Array<T> data, int threads = 0)
+    {
+        if (threads <= 0) threads = std::thread::hardware_concurrency ();
+        if (threads <= 0) threads = 1;
+
+        T* keys = new T[data.length];
+
+        for (size_t i = 0; i < data.length; i++) keys[i] = data.data[i];
+
+        if (!std::is_sorted (keys, keys + data.length))
+            Tree<T>::sort (keys, data.length, threads);
+
+        clean ();
+
+        if (data.length)
+        {
+            int levels = 1;
+
+            while (capacity (levels) < data.length) levels++;
+
+            pool.reserve (2 * data.length / HALF + levels + 1);
+            weights.reserve (pool.size);
+
+            root = build (keys, data.length, levels);
+        }
+
+        delete[] keys;
+    }
+
+    // Key slots: the j-th key of node n is slot (n - 1) * KEYS + j + 1
+
+    Index slot (Index node, int j) { return (node - 1) * KEYS + j + 1; }
+
+    Index node_of (Index slot) { return (slot - 1) / KEYS + 1; }
+
+    int key_of (Index slot) { return (slot - 1) % KEYS; }
+
+    Index slots () { return (pool.length - 1) * KEYS + 1; }
+
+    // Whether a slot holds a key now; splits leave the upper ones empty
+    bool used (Index slot)
+    {
+        return key_of (slot) < (int)pool.data[node_of (slot)].count;
+    }
+
+    Index first (Index node) { return node ? slot (node, 0) : 0; }
+
+    Index left (Index slot)
+    {
+        return slot ? first (pool.data[node_of (slot)].children[key_of (slot)])
+                    : 0;
+    }
+
+    Index right (Index slot)
+    {
+        if (!slot) return 0;
+
+        Node& n = pool.data[node_of (slot)];
+
+        return key_of (slot) + 1 < (int)n.count ? slot + 1
+                                                : first (n.children[n.count]);
+    }
+
+    // Keys from slot's key to the end of its node, with their subtrees
+    uint32_t weight (Index slot)
+    {
+        Node&    n     = pool.data[node_of (slot)];
+        int      j     = key_of (slot);
+        uint32_t count = n.count - j;
+
+        for (uint32_t i = j; i <= n.count; i++)
+            count += weights.data[n.children[i]];
+
+        return count;
+    }
+
+    Slot operator[] (Index slot)
+    {
+        Index node = node_of (slot);
+        Node& n    = pool.data[node];
+        int   j    = key_of (slot);
+
+        Slot s;
+
+        s.data   = n.keys[j];
+        s.weight = weight (slot);
+        s.dirty  = true;
+        s.left   = left (slot);
+        s.right  = right (slot);
+
+        Index lo = node, hi = node;
+
+        for (Index c = n.children[j]; c; c = pool.data[c].children[0])
+            lo = c;
+
+        while (pool.data[hi].children[pool.data[hi].count])
+            hi = pool.data[hi].children[pool.data[hi].count];
+
+        s.min = lo == node ? n.keys[j] : pool.data[lo].keys[0];
+        s.max = pool.data[hi].keys[pool.data[hi].count - 1];
+
+        return s;
+    }
+
+    // Keys less than `key`
+    uint32_t rank (const T& key)
+    {
+        uint32_t count = 0;
+
+        for (Index node = root; node;)
+        {
+            Node& n = pool.data[node];
+            int   i = scan::lower (n.keys, n.count, key);
+
+            count += i;
+
+            for (int j = 0; j < i; j++)
+                count += weights.data[n.children[j]];
+
+            node = n.children[i];
+        }
+
+        return count;
+    }
+
+    // Key slot of the k-th smallest key counting from 0, nil past the end
+    Index select (uint32_t k)
+    {
+        for (Index node = root; node;)
+        {
+            Node& n = pool.data[node];
+
+            for (uint32_t i = 0;; i++)
+            {
+                uint32_t below = weights.data[n.children[i]];
+
+                if (k < below)
+                {
+                    node = n.children[i];
+                    break;
+                }
+
+                k -= below;
+
+                if (i == n.count) return 0;
+
+                if (k == 0) return slot (node, i);
+
+                k--;
+            }
+        }
+
+        return 0;
+    }
+
+    template <class S, class F> void preorder (Index node, S state, F visit)
+    {
+        ::preorder (*this, node, state, visit);
+    }
+
+    template <class F> void preorder (Index node, F visit)
+    {
+        preorder (node, 0, [&] (Index index, int, int&, int&) -> bool {
+            return visit (index);
+        });
+    }
+
+    // Levels of nodes, every leaf is on the last
+    int height ()
+    {
+        int levels = 0;
+
+        for (Index node = root; node; node = pool.data[node].children[0])
+            levels++;
+
+        return levels;
+    }
+
+    int size () { return weights.data[root]; }
+
+    void clean ()
+    {
+        pool.clean ();
+        weights.clean ();
+        freed.clean ();
+        init ();
+    }
+};
+
+static_assert (sizeof (BTree<float>::Node) == 128,
+               "a float node must stay two cache lines");
+
+// Lets a producer thread keep inserting into a tree while the renderer
+// draws it. There are two copies of the tree: the renderer takes the one
+// last published and the producer inserts into the other, publishes it,
+// and then turns to the first as soon as the renderer has moved off it.
+// Neither side waits: keys that arrive while the renderer still holds
+// the stale copy queue in the log, which both copies replay in the same
+// order, so their slots stay identical and the layout mirrors either.
+// A copy's dirty flags cover every change since the renderer last laid
+// it out, which is all the layout needs even when it switches copies
+template <class T, class Balance = balance::None> struct Feed
+{
+    Tree<T, Balance> copies[2];
+    Array<T>         log;           // producer only, see trim
+    size_t           applied[2];    // log entries each copy has
+
+    std::atomic<int>      front;        // copy the renderer takes next
+    std::atomic<int>      reading;      // copy it holds, -1 between frames
+    std::atomic<uint32_t> published;    // keys in the front copy
+    std::atomic<uint32_t> received;     // keys handed to push so far
+    std::atomic<bool>     stop;
+    std::thread           producer;
+
+    Feed ()
+    {
+        front     = 0;
+        reading   = -1;
+        published = received = 0;
+        stop                 = false;
+
+        applied[0] = applied[1] = 0;
+    }
+
+    // Both copies start from the same bulk build, before the producer runs
+    void seed (Array<T> keys)
+    {
+        copies[0].build (keys);
+        copies[1].build (keys);
+
+        published = received = keys.length;
+    }
+
+    // Renderer side. Announces the copy it is about to read, then checks
+    // that it is still the front: a publish in between means the producer
+    // may have missed the announcement, so it tries again
+    Tree<T, Balance>& acquire ()
+    {
+        int copy;
+
+        do {
+            copy = front.load ();
+            reading.store (copy);
+        } while (front.load () != copy);
+
+        return copies[copy];
+    }
+
+    void release () { reading.store (-1); }
+
+    // Producer side. Only the producer moves front, so the back copy it
+    // reads here can't change under it
+    void push (const T* keys, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) log.push (keys[i]);
+
+        received += count;
+
+        int back = 1 - front.load ();
+
+        if (reading.load () == back) return;
+
+        Tree<T, Balance>& tree = copies[back];
+
+        for (size_t i = applied[back]; i < log.length; i++)
+            tree.push (log.data[i]);
+
+        applied[back] = log.length;
+
+        front.store (back);
+        published.store (tree.size ());
+
+        trim ();
+    }
+
+    // Drops the keys both copies have, once they are half the log
+    void trim ()
+    {
+        size_t done = applied[0] < applied[1] ? applied[0] : applied[1];
+
+        if (done < log.length / 2) return;
+
+        for (size_t i = done; i < log.length; i++)
+            log.data[i - done] = log.data[i];
+
+        log.length -= done;
+        applied[0] -= done;
+        applied[1] -= done;
+    }
+
+    // Starts the producer on `next` (), `rate` keys a second or as fast
+    // as the copies take them when 0, handing them over in batches. A
+    // made-up feed could otherwise outrun the inserts without bound
+    template <class F> void start (size_t rate, F next)
+    {
+        producer = std::thread ([this, rate, next] () mutable {
+            T      batch[256];
+            size_t sent  = 0;
+            Uint32 begin = SDL_GetTicks ();
+
+            while (!stop.load ())
+            {
+                size_t count = 256;
+
+                if (rate)
+                {
+                    double due
+                        = (SDL_GetTicks () - begin) / 1000.0 * rate - sent;
+
+                    if (due < 1)
+                    {
+                        SDL_Delay (1);
+                        continue;
+                    }
+
+                    if (due < count) count = due;
+                }
+                else if (received.load () - published.load () > 65536)
+                    count = 0;
+
+                for (size_t i = 0; i < count; i++) batch[i] = next ();
+
+                push (batch, count);
+
+                if (!count) std::this_thread::yield ();
+
+                sent += count;
+            }
+        });
+    }
+
+    void finish ()
+    {
+        stop.store (true);
+
+        if (producer.joinable ()) producer.join ();
+    }
+
+    void clean ()
+    {
+        finish ();
+
+        copies[0].clean ();
+        copies[1].clean ();
+        log.clean ();
+    }
+};
+
+// Ring for one producer thread and one consumer thread, N - 1 items deep.
+// Lock-free: only the producer moves tail and only the consumer head
+template <class T, size_t N> struct Spsc
+{
+    T                   items[N];
+    std::atomic<size_t> head, tail;
+
+    Spsc ()
+    {
+        head = 0;
+        tail = 0;
+    }
+
+    bool push (const T& item)
+    {
+        size_t at = tail.load (std::memory_order_relaxed), next = (at + 1) % N;
+
+        if (next == head.load (std::memory_order_acquire)) return false;
+
+        items[at] = item;
+        tail.store (next, std::memory_order_release);
+
+        return true;
+    }
+
+    bool pop (T& item)
+    {
+        size_t at = head.load (std::memory_order_relaxed);
+
+        if (at == tail.load (std::memory_order_acquire)) return false;
+
+        item = items[at];
+        head.store ((at + 1) % N, std::memory_order_release);
+
+        return true;
+    }
+};
+
+// Counting semaphore, so the side of a ring with nothing to do can sleep
+struct Signal
+{
+    std::mutex              lock;
+    std::condition_variable wake;
+    int                     count;
+
+    Signal () { count = 0; }
+
+    void post ()
+    {
+        {
+            std::lock_guard<std::mutex> hold (lock);
+
+            count++;
+        }
+
+        wake.notify_one ();
+    }
+
+    void wait ()
+    {
+        std::unique_lock<std::mutex> hold (lock);
+
+        wake.wait (hold, [&] { return count > 0; });
+
+        count--;
+    }
+};
+
+// Fork-join pool for frame work over tree items. Every worker owns a
+// deque: it runs the newest item it has and, once that is empty, steals
+// the oldest of another worker's, which in a tree walk is the biggest
+// piece left. The thread that calls run is worker 0, so a pool of one
+// starts no threads. Idle workers sleep between runs
+struct Workers
+{
+    struct Deque
+    {
+        std::mutex      lock;
+        Array<uint32_t> items;
+        size_t          head;    // oldest item, where thieves take from
+
+        Deque () { head = 0; }
+    };
+
+    int                                 count;
+    Deque*                              deques;
+    Array<std::thread>                  threads;
+    std::function<void (int, uint32_t)> body;
+    std::atomic<int>                    pending;    // spawned, not done
+    std::atomic<bool>                   stop;
+    std::mutex                          sleep;
+    std::condition_variable             wake;
+    uint64_t                            round;
+
+    Workers ()
+    {
+        count   = 0;
+        deques  = nullptr;
+        pending = 0;
+        stop    = false;
+        round   = 0;
+    }
+
+    void start (int workers)
+    {
+        count  = workers < 1 ? 1 : workers;
+        deques = new Deque[count];
+
+        for (int i = 1; i < count; i++)
+            threads.emplace ([this, i] () { work (i); });
+    }
+
+    // From inside body: queues more work on the calling worker
+    void spawn (int worker, uint32_t item)
+    {
+        pending++;
+
+        std::lock_guard<std::mutex> hold (deques[worker].lock);
+
+        deques[worker].items.push (item);
+    }
+
+    bool take (int worker, uint32_t& item)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            Deque& deque = deques[(worker + i) % count];
+
+            std::lock_guard<std::mutex> hold (deque.lock);
+
+            if (deque.items.length == deque.head)
+            {
+                deque.items.length = deque.head = 0;
+                continue;
+            }
+
+            item = i ? deque.items.data[deque.head++] : deque.items.pop ();
+
+            return true;
+        }
+
+        return false;
+    }
+
+    // body (worker, item) for every item and whatever it spawns; returns
+    // once all of it ran
+    template <class F> void run (const uint32_t* items, size_t length, F f)
+    {
+        body = f;
+
+        for (size_t i = 0; i < length; i++) spawn (i % count, items[i]);
+
+        {
+            std::lock_guard<std::mutex> hold (sleep);
+
+            round++;
+        }
+
+        wake.notify_all ();
+
+        uint32_t item;
+
+        while (pending.load ())
+        {
+            if (!take (0, item))
+            {
+                std::this_thread::yield ();
+                continue;
+            }
+
+            body (0, item);
+            pending--;
+        }
+    }
+
+    void work (int worker)
+    {
+        uint64_t seen = 0;
+        uint32_t item;
+
+        for (;;)
+        {
+            if (take (worker, item))
+            {
+                body (worker, item);
+                pending--;
+                continue;
+            }
+
+            std::unique_lock<std::mutex> hold (sleep);
+
+            if (stop) return;
+
+            if (pending.load ())
+            {
+                hold.unlock ();
+                std::this_thread::yield ();
+                continue;
+            }
+
+            wake.wait (hold, [&] { return stop || round != seen; });
+
+            seen = round;
+        }
+    }
+
+    void finish ()
+    {
+        {
+            std::lock_guard<std::mutex> hold (sleep);
+
+            stop = true;
+        }
+
+        wake.notify_all ();
+
+        for (std::thread& thread : threads) thread.join ();
+
+        threads.clean ();
+
+        for (int i = 0; i < count; i++) deques[i].items.clean ();
+
+        delete[] deques;
+        deques = nullptr;
+    }
+};
+
+void print (Tree<int>& tree, Tree<int>::Index node)
+{
+    tree.preorder (node, [&] (Tree<int>::Index index) {
+        printf ("%d\n", tree[index].data);
+        return true;
+    });
+}
+
+// Text and keys. Up to SMALL characters live inside the struct, longer
+// text on the heap, and either way it stays null terminated. The length
+// and an FNV-1a hash are kept current as it grows, so comparisons take
+// references, never allocate, and unequal keys mostly part on the hash.
+// Copies share heap text as the other containers here do and clean ()
+// frees it, which a Tree<string> never does for its keys
+struct string
+{
+    static const uint32_t SMALL = 23;
+
+    static size_t allocations;    // heap buffers made by any string
+
+    union
+    {
+        char  small[SMALL + 1];
+        char* heap;
+    };
+
+    uint32_t length, capacity, hash;
+
+    string ()
+    {
+        small[0] = '\0';
+        length   = 0;
+        capacity = SMALL;
+        hash     = 2166136261u;
+    }
+
+    string (const char* str) : string () { append (str, strlen (str)); }
+
+    string (const char* str, size_t count) : string () { append (str, count); }
+
+    // Empty, with room for `size` characters
+    explicit string (size_t size) : string () { reserve (size); }
+
+    char*       data () { return capacity > SMALL ? heap : small; }
+    const char* data () const { return capacity > SMALL ? heap : small; }
+    const char* c_str () const { return data (); }
+
+    void reserve (size_t size)
+    {
+        if (size <= capacity) return;
+
+        char* text = new char[size + 1];
+
+        memcpy (text, data (), length + 1);
+
+        if (capacity > SMALL) delete[] heap;
+
+        heap     = text;
+        capacity = size;
+
+        allocations++;
+    }
+
+    void push (char c)
+    {
+        if (length == capacity) reserve (capacity * 2);
+
+        char* text = data ();
+
+        text[length++] = c;
+        text[length]   = '\0';
+
+        hash = (hash ^ (unsigned char)c) * 16777619u;
+    }
+
+    void append (const char* str, size_t count)
+    {
+        reserve (length + count);
+
+        char* text = data ();
+
+        memcpy (text + length, str, count);
+
+        for (size_t i = 0; i < count; i++)
+            hash = (hash ^ (unsigned char)str[i]) * 16777619u;
+
+        length += count;
+        text[length] = '\0';
+    }
+
+    // Adopts `count` characters written past the end of data ()
+    void written (size_t count)
+    {
+        char* text = data () + length;
+
+        for (size_t i = 0; i < count; i++)
+            hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+
+        length += count;
+        data ()[length] = '\0';
+    }
+
+    void clean ()
+    {
+        if (capacity > SMALL) delete[] heap;
+
+        *this = string ();
+    }
+
+    // Read only: writing through an index would leave the hash stale
+    char operator[] (size_t index) const { return data ()[index]; }
+
+    int compare (const string& b) const
+    {
+        uint32_t shorter = length < b.length ? length : b.length;
+
+        int order = memcmp (data (), b.data (), shorter);
+
+        if (order) return order;
+
+        return (length > b.length) - (length < b.length);
+    }
+
+    bool operator< (const string& b) const { return compare (b) < 0; }
+    bool operator> (const string& b) const { return compare (b) > 0; }
+
+    bool operator== (const string& b) const
+    {
+        return length == b.length && hash == b.hash
+               && memcmp (data (), b.data (), length) == 0;
+    }
+
+    bool operator!= (const string& b) const { return !(*this == b); }
+};
+
+size_t string::allocations = 0;
+
+// The whole file in one read
+string read_file (const char* filename)
+{
+    FILE* fp = fopen (filename, "rb");
+
+    assert (fp != nullptr);
+
+    fseek (fp, 0, SEEK_END);
+    size_t size = ftell (fp);
+
+    fseek (fp, 0, SEEK_SET);
+
+    string str (size);
+
+    str.written (fread (str.data (), 1, size, fp));
+
+    fclose (fp);
+
+    return str;
+}
+
+// FNV-1a, chained through `hash` to cover several buffers
+uint64_t fnv1a (const void* data, size_t length,
+                uint64_t hash = 14695981039346656037ULL)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+// Loads keys for Tree<float> from text files, raw float32 files (".f32")
+// and stdin. Files are mapped rather than read, text is split across
+// threads at separators and parsed in place
+namespace keys
+{
+    struct Mapped
+    {
+        const char* data   = nullptr;
+        size_t      length = 0;
+        bool        mapped = false;
+        int         error  = 0;    // errno when the file couldn't be read
+
+        void clean ()
+        {
+#ifndef _WIN32
+            if (mapped) munmap ((void*)data, length);
+            else delete[] data;
+#else
+            delete[] data;
+#endif
+            data   = nullptr;
+            length = 0;
+            mapped = false;
+        }
+    };
+
+    // Maps the whole file read-only, or reads it in one go where mmap is
+    // missing. A file that can't be read comes back empty with its errno
+    Mapped map (const char* filename)
+    {
+        Mapped file;
+
+#ifndef _WIN32
+        int fd = open (filename, O_RDONLY);
+
+        if (fd < 0)
+        {
+            file.error = errno;
+            return file;
+        }
+
+        struct stat info;
+
+        if (fstat (fd, &info) != 0) file.error = errno;
+        else if (info.st_size > 0)
+        {
+            void* data = mmap (nullptr, info.st_size, PROT_READ, MAP_PRIVATE,
+                               fd, 0);
+
+            if (data != MAP_FAILED)
+            {
+                madvise (data, info.st_size, MADV_SEQUENTIAL);
+
+                file.data   = (const char*)data;
+                file.length = info.st_size;
+                file.mapped = true;
+            }
+            else file.error = errno;
+        }
+
+        close (fd);
+#else
+        FILE* fp = fopen (filename, "rb");
+
+        if (!fp)
+        {
+            file.error = errno;
+            return file;
+        }
+
+        fseek (fp, 0, SEEK_END);
+        size_t size = ftell (fp);
+        fseek (fp, 0, SEEK_SET);
+
+        char* data = new char[size];
+
+        file.length = fread (data, 1, size, fp);
+        file.data   = data;
+
+        fclose (fp);
+#endif
+
+        return file;
+    }
+
+    // Eight ascii digits at once: checked and combined inside one 64-bit
+    // word instead of one character at a time
+    inline bool eight_digits (const char* p)
+    {
+        uint64_t v;
+
+        memcpy (&v, p, 8);
+
+        return ((v & 0xF0F0F0F0F0F0F0F0)
+                | (((v + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4))
+               == 0x3333333333333333;
+    }
+
+    inline uint32_t parse_eight (const char* p)
+    {
+        uint64_t v;
+
+        memcpy (&v, p, 8);
+
+        v -= 0x3030303030303030;
+        v = (v * 10) + (v >> 8);
+        v = (((v & 0x000000FF000000FF) * (100 + (1000000ULL << 32)))
+             + (((v >> 16) & 0x000000FF000000FF) * (1 + (10000ULL << 32))))
+            >> 32;
+
+        return (uint32_t)v;
+    }
+
+    // Exact in double, so scaling by one of them rounds only once
+    const double powers[]
+        = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+            1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+            1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    // value * 10^exponent
+    inline double scale (double value, int exponent)
+    {
+        for (; exponent > 22; exponent -= 22) value *= powers[22];
+        for (; exponent < -22; exponent += 22) value /= powers[22];
+
+        return exponent < 0 ? value / powers[-exponent]
+                            : value * powers[exponent];
+    }
+
+    inline bool digit (char c) { return (unsigned char)(c - '0') < 10; }
+
+    inline bool separator (char c)
+    {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == ','
+               || c == ';';
+    }
+
+    // Folds a run of digits into the mantissa, dropping those that no
+    // longer fit and counting them into the exponent instead. Digits go in
+    // while the mantissa is under 10^18 and none after, eight at a time
+    // only while all eight fit, so the kept digits are always the leading
+    // ones however the run splits into blocks
+    inline const char* digits (const char* p, const char* end,
+                               uint64_t& mantissa, int& dropped)
+    {
+        while (end - p >= 8 && mantissa < 10000000000ULL && eight_digits (p))
+        {
+            mantissa = mantissa * 100000000 + parse_eight (p);
+
+            p += 8;
+        }
+
+        for (; p < end && digit (*p); p++)
+        {
+            if (mantissa < 1000000000000000000ULL)
+                mantissa = mantissa * 10 + (*p - '0');
+            else dropped++;
+        }
+
+        return p;
+    }
+
+    // Parses one decimal number, returns p unchanged when there is none
+    const char* parse (const char* p, const char* end, float& value)
+    {
+        const char* start    = p;
+        bool        negative = false;
+
+        if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+
+        uint64_t    mantissa = 0;
+        int         exponent = 0;
+        const char* first    = p;
+
+        p = digits (p, end, mantissa, exponent);
+
+        if (p < end && *p == '.')
+        {
+            int         dropped = 0;
+            const char* point   = ++p;
+
+            p = digits (p, end, mantissa, dropped);
+
+            exponent -= (int)(p - point) - dropped;
+        }
+
+        if (p == first || (p == first + 1 && *first == '.')) return start;
+
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            const char* mark = p++;
+            bool        down = false;
+
+            if (p < end && (*p == '-' || *p == '+')) down = (*p++ == '-');
+
+            if (p < end && digit (*p))
+            {
+                int e = 0;
+
+                for (; p < end && digit (*p); p++)
+                    if (e < 10000) e = e * 10 + (*p - '0');
+
+                exponent += down ? -e : e;
+            }
+            else p = mark;
+        }
+
+        if (exponent > 60) exponent = 60;
+        if (exponent < -80) exponent = -80;
+
+        double result = mantissa ? scale ((double)mantissa, exponent) : 0;
+
+        value = (float)(negative ? -result : result);
+
+        return p;
+    }
+
+    // Writes the fewest significant digits, up to `precision`, that read
+    // back as the same float: plain up to 9 integer digits, scientific
+    // beyond that and below 1e-5. Candidates are rounded in double and
+    // checked against the float, shortest first. Returns the length, at
+    // most 16 characters plus the terminator
+    int format (float value, char* out, int precision = 9)
+    {
+        char* p = out;
+
+        if (precision < 1) precision = 1;
+        if (precision > 9) precision = 9;
+
+        if (value != value)
+        {
+            memcpy (out, "nan", 4);
+            return 3;
+        }
+
+        if (value < 0)
+        {
+            *p++  = '-';
+            value = -value;
+        }
+
+        if (value > 3.4028235e38f)
+        {
+            memcpy (p, "inf", 4);
+            return p - out + 3;
+        }
+
+        if (value == 0)
+        {
+            memcpy (out, "0", 2);
+            return 1;
+        }
+
+        // Decimal exponent of the leading digit, estimated from the binary
+        // one (log10(2) ~ 78913 / 2^18) and corrected by at most one
+        double v = value;
+        int    e2;
+
+        frexp (v, &e2);
+
+        int exponent = ((e2 - 1) * 78913) >> 18;
+
+        if (scale (1, exponent + 1) <= v) exponent++;
+        if (scale (1, exponent) > v) exponent--;
+
+        uint64_t digits = 0;
+        int      count  = 1, lead = exponent;
+
+        for (;; count++)
+        {
+            digits = (uint64_t)(scale (v, count - 1 - exponent) + 0.5);
+            lead   = exponent;
+
+            // 9.96 to two digits rounds up to 100, one more leading digit
+            if (digits >= (uint64_t)powers[count])
+            {
+                digits /= 10;
+                lead++;
+            }
+
+            if (count == precision
+                || (float)scale ((double)digits, lead - count + 1) == value)
+                break;
+        }
+
+        exponent = lead;
+
+        for (; count > 1 && digits % 10 == 0; count--) digits /= 10;
+
+        char text[10];
+
+        for (int i = count; i-- > 0; digits /= 10) text[i] = '0' + digits % 10;
+
+        if (exponent >= 0 && exponent < 9)
+        {
+            for (int i = 0; i <= exponent || i < count; i++)
+            {
+                if (i == exponent + 1) *p++ = '.';
+
+                *p++ = i < count ? text[i] : '0';
+            }
+        }
+        else if (exponent < 0 && exponent >= -5) {
+            *p++ = '0';
+            *p++ = '.';
+
+            for (int i = -1; i > exponent; i--) *p++ = '0';
+            for (int i = 0; i < count; i++) *p++ = text[i];
+        }
+        else {
+            *p++ = text[0];
+
+            if (count > 1) *p++ = '.';
+
+            for (int i = 1; i < count; i++) *p++ = text[i];
+
+            *p++ = 'e';
+            *p++ = exponent < 0 ? '-' : '+';
+
+            int e = exponent < 0 ? -exponent : exponent;
+
+            if (e >= 10) *p++ = '0' + e / 10;
+
+            *p++ = '0' + e % 10;
+        }
+
+        *p = '\0';
+
+        return p - out;
+    }
+
+    // Every number in [p, end), anything between numbers that is not part
+    // of one is skipped
+    void parse (const char* p, const char* end, Array<float>& out)
+    {
+        float value;
+
+        while (p < end)
+        {
+            while (p < end && !digit (*p) && *p != '-' && *p != '+'
+                   && *p != '.')
+                p++;
+
+            if (p == end) break;
+
+            const char* next = parse (p, end, value);
+
+            if (next == p) p++;
+            else {
+                out.push (value);
+                p = next;
+            }
+        }
+    }
+
+    // Cuts the text into one slice per thread at separators, parses them
+    // side by side and appends the results in order
+    void parse (const char* data, size_t length, Array<float>& out,
+                int threads)
+    {
+        if (threads <= 0) threads = std::thread::hardware_concurrency ();
+        if (threads <= 0 || length < 1 << 20) threads = 1;
+
+        if (threads == 1)
+        {
+            out.reserve (out.length + length / 8);
+            parse (data, data + length, out);
+            return;
+        }
+
+        const char*  cuts[65];
+        Array<float> parts[64];
+        std::thread  workers[64];
+
+        if (threads > 64) threads = 64;
+
+        cuts[0]       = data;
+        cuts[threads] = data + length;
+
+        for (int t = 1; t < threads; t++)
+        {
+            const char* cut = data + length / threads * t;
+
+            if (cut < cuts[t - 1]) cut = cuts[t - 1];
+
+            while (cut < data + length && !separator (*cut)) cut++;
+
+            cuts[t] = cut;
+        }
+
+        for (int t = 0; t < threads; t++)
+        {
+            workers[t] = std::thread ([&, t] () {
+                parts[t].reserve ((cuts[t + 1] - cuts[t]) / 8);
+                parse (cuts[t], cuts[t + 1], parts[t]);
+            });
+        }
+
+        size_t total = out.length;
+
+        for (int t = 0; t < threads; t++)
+        {
+            workers[t].join ();
+            total += parts[t].length;
+        }
+
+        out.reserve (total);
+
+        for (int t = 0; t < threads; t++)
+        {
+            memcpy (out.data + out.length, parts[t].data,
+                    parts[t].length * sizeof (float));
+
+            out.length += parts[t].length;
+
+            parts[t].clean ();
+        }
+    }
+
+    // Keys from `filename`, or stdin for "-". Raw float32 files are copied
+    // out of the mapping in one go. The keys are the caller's to clean ();
+    // `file` is unmapped before this returns and only keeps its error
+    Array<float> load (const char* filename, Mapped& file, int threads = 0)
+    {
+        Array<float> out;
+
+        if (strcmp (filename, "-") == 0)
+        {
+            // Large blocks, with the number cut off at the end of each one
+            // carried over to the front of the next
+            const size_t block = 1 << 24;
+
+            char*  buffer = new char[block];
+            size_t carry  = 0;
+
+            while (true)
+            {
+                size_t read  = fread (buffer + carry, 1, block - carry, stdin);
+                size_t valid = carry + read;
+
+                if (read == 0)
+                {
+                    parse (buffer, valid, out, threads);
+                    break;
+                }
+
+                size_t cut = valid;
+
+                while (cut > 0 && !separator (buffer[cut - 1])) cut--;
+
+                if (cut == 0) cut = valid;
+
+                parse (buffer, cut, out, threads);
+
+                carry = valid - cut;
+                memmove (buffer, buffer + cut, carry);
+            }
+
+            delete[] buffer;
+
+            return out;
+        }
+
+        file = map (filename);
+
+        size_t name = strlen (filename);
+
+        if (name > 4 && strcmp (filename + name - 4, ".f32") == 0)
+        {
+            size_t count = file.length / sizeof (float);
+
+            out.reserve (count);
+
+            if (count) memcpy (out.data, file.data, count * sizeof (float));
+
+            out.length = count;
+        }
+        else parse (file.data, file.length, out, threads);
+
+        file.clean ();
+
+        return out;
+    }
+}
+
+const float W = 1280.f;
+const float H = 720.f;
+
+// Per-instance attributes of the unit quad, see vertex.glsl
+struct Instance
+{
+    Vec4  rect;      // x, y, w, h
+    Vec4  color;     // r, g, b, a
+    Vec4  offset;    // atlas uv: x, y, w, h
+    float angle, type;
+};
+
+// GL work issued per frame, reset by whoever reports it
+struct GLStats
+{
+    size_t calls, uniforms, skipped, draws;
+
+    void reset () { calls = uniforms = skipped = draws = 0; }
+
+    void draw () { calls++, draws++; }
+};
+
+GLStats gl_stats;
+
+// A buffer the CPU refills every frame. With buffer storage it stays
+// mapped for its whole life and is split into three regions, each fenced
+// once drawn from, so writing the next region never waits on the GPU
+// still reading the last one. Older contexts orphan it on every write
+struct Stream
+{
+    static const int REGIONS = 3;
+
+    struct Stats
+    {
+        size_t bytes, writes, waits, orphans, grows;
+        double waited;    // seconds blocked on fences
+
+        void reset ()
+        {
+            bytes = writes = waits = orphans = grows = 0;
+            waited = 0;
+        }
+    };
+
+    uint   id;
+    size_t size;      // bytes per region
+    size_t head;      // bytes written into the current region
+    int    region;
+    bool   persistent;
+    char*  mapped;    // start of the persistent mapping
+    GLsync fences[REGIONS];
+    Stats  stats;
+
+    Stream ()
+    {
+        id = size = head = region = 0;
+        persistent = false;
+        mapped     = nullptr;
+
+        for (GLsync& fence : fences) fence = 0;
+
+        stats.reset ();
+    }
+
+    void init (size_t bytes)
+    {
+        size       = bytes;
+        head       = 0;
+        region     = 0;
+        persistent = GLEW_ARB_buffer_storage != 0;
+
+        glGenBuffers (1, &id);
+        glBindBuffer (GL_ARRAY_BUFFER, id);
+
+        if (persistent)
+        {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT
+                                     | GL_MAP_COHERENT_BIT;
+
+            glBufferStorage (GL_ARRAY_BUFFER, size * REGIONS, nullptr, flags);
+
+            mapped = (char*)glMapBufferRange (GL_ARRAY_BUFFER, 0,
+                                              size * REGIONS, flags);
+
+            if (!mapped)
+            {
+                glDeleteBuffers (1, &id);
+                glGenBuffers (1, &id);
+                glBindBuffer (GL_ARRAY_BUFFER, id);
+
+                persistent = false;
+            }
+        }
+
+        if (!persistent)
+            glBufferData (GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    }
+
+    void clean ()
+    {
+        for (GLsync& fence : fences)
+        {
+            if (fence) glDeleteSync (fence);
+
+            fence = 0;
+        }
+
+        if (persistent)
+        {
+            glBindBuffer (GL_ARRAY_BUFFER, id);
+            glUnmapBuffer (GL_ARRAY_BUFFER);
+        }
+
+        glDeleteBuffers (1, &id);
+
+        id = 0, mapped = nullptr;
+    }
+
+    void wait (GLsync& fence)
+    {
+        if (!fence) return;
+
+        GLenum state = glClientWaitSync (fence, 0, 0);
+
+        if (state == GL_TIMEOUT_EXPIRED)
+        {
+            double start = SDL_GetPerformanceCounter ()
+                           / (double)SDL_GetPerformanceFrequency ();
+
+            stats.waits++;
+
+            while (state == GL_TIMEOUT_EXPIRED)
+                state = glClientWaitSync (fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                          1000000);
+
+            stats.waited += SDL_GetPerformanceCounter ()
+                                / (double)SDL_GetPerformanceFrequency ()
+                            - start;
+        }
+
+        glDeleteSync (fence);
+        fence = 0;
+    }
+
+    // Room for `bytes` in this frame's region, the returned pointer is
+    // written through until end() and `offset` is where it lands in the
+    // buffer. Regions too small are regrown once the GPU lets go of them
+    void* begin (size_t bytes, size_t& offset)
+    {
+        glBindBuffer (GL_ARRAY_BUFFER, id);
+
+        if (head + bytes > size)
+        {
+            size_t grown = size;
+
+            while (head + bytes > grown) grown *= 2;
+
+            for (GLsync& fence : fences) wait (fence);
+
+            clean ();
+            init (grown);
+
+            glBindBuffer (GL_ARRAY_BUFFER, id);
+
+            stats.grows++;
+        }
+
+        stats.bytes += bytes;
+        stats.writes++;
+
+        if (persistent)
+        {
+            wait (fences[region]);
+
+            offset = region * size + head;
+            head += bytes;
+
+            return mapped + offset;
+        }
+
+        if (head == 0)
+        {
+            glBufferData (GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+            stats.orphans++;
+        }
+
+        offset = head;
+        head += bytes;
+
+        return glMapBufferRange (GL_ARRAY_BUFFER, offset, bytes,
+                                 GL_MAP_WRITE_BIT
+                                     | GL_MAP_UNSYNCHRONIZED_BIT);
+    }
+
+    void end ()
+    {
+        if (!persistent) glUnmapBuffer (GL_ARRAY_BUFFER);
+    }
+
+    // After the last draw reading this frame's writes: fences the region
+    // and moves on to the next one
+    void next ()
+    {
+        if (persistent)
+        {
+            if (head)
+                fences[region]
+                    = glFenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+            region = (region + 1) % REGIONS;
+        }
+
+        head = 0;
+    }
+};
+
+// Every uniform the shaders declare, resolved once at link time
+enum UNIFORMS
+{
+    U_MODEL,
+    U_PROJECTION,
+    U_COLOR,
+    U_OFFSET,
+    U_IMAGE,
+    U_TYPE,
+    U_ALPHA,
+    U_INSTANCED,
+    UNIFORMS_COUNT,
+};
+
+const char* uniform_names[UNIFORMS_COUNT] = {
+    "u_model", "u_projection", "u_color", "u_offset",
+    "u_image", "u_type",       "u_alpha", "u_instanced",
+};
+
+struct Shader
+{
+    uint   vao, vbo;
+    Stream instances;    // per-instance attributes, see Instance
+    sint id, vertex, fragment;
+
+    sint  locations[UNIFORMS_COUNT];
+    float shadow[UNIFORMS_COUNT][16];    // last value sent per uniform
+    bool  sent[UNIFORMS_COUNT];
+
+    Shader () { id = vertex = fragment = vbo = vao = 0; }
+
+    Shader (const char* vs_file, const char* fs_file)
+    {
+        init (vs_file, fs_file);
+    }
+
+    // false when the uniform already holds this value
+    bool changed (UNIFORMS u, const void* val, size_t bytes)
+    {
+        if (sent[u] && memcmp (shadow[u], val, bytes) == 0)
+        {
+            gl_stats.skipped++;
+            return false;
+        }
+
+        memcpy (shadow[u], val, bytes);
+        sent[u] = true;
+
+        gl_stats.uniforms++;
+        gl_stats.calls++;
+
+        return true;
+    }
+
+    void set (UNIFORMS u, sint val)
+    {
+        if (changed (u, &val, sizeof (val))) glUniform1i (locations[u], val);
+    }
+
+    void set (UNIFORMS u, float val)
+    {
+        if (changed (u, &val, sizeof (val))) glUniform1f (locations[u], val);
+    }
+
+    void set (UNIFORMS u, Vec3 val)
+    {
+        if (changed (u, val.data, sizeof (val.data)))
+            glUniform3fv (locations[u], 1, val.data);
+    }
+
+    void set (UNIFORMS u, Vec4 val)
+    {
+        if (changed (u, val.data, sizeof (val.data)))
+            glUniform4fv (locations[u], 1, val.data);
+    }
+
+    void set (UNIFORMS u, Vec2 val)
+    {
+        if (changed (u, val.data, sizeof (val.data)))
+            glUniform2fv (locations[u], 1, val.data);
+    }
+
+    void set (UNIFORMS u, Mat4 val)
+    {
+        if (changed (u, val.data, sizeof (val.data)))
+            glUniformMatrix4fv (locations[u], 1, GL_TRUE, val[0]);
+    }
+
+    bool cached;    // linked from the program binary cache
+
+    sint compile (string code, uint type)
+    {
+        const char* source = code.data ();
+        sint        length = code.length;
+        sint        shader = glCreateShader (type), is_compiled = 0;
+
+        glShaderSource (shader, 1, &source, &length);
+        glCompileShader (shader);
+        glGetShaderiv (shader, GL_COMPILE_STATUS, &is_compiled);
+
+        if (is_compiled == GL_FALSE)
+        {
+            char info_log[512];
+            sint max_length = 0;
+
+            glGetShaderiv (shader, GL_INFO_LOG_LENGTH, &max_length);
+            glGetShaderInfoLog (shader, max_length, &max_length, &info_log[0]);
+
+            glDeleteShader (shader);
+
+            assert (is_compiled != GL_FALSE);
+        }
+
+        return shader;
+    }
+
+    // Linked programs are cached under the user's pref path, one file per
+    // hash of both sources and the driver strings, so an edited shader or
+    // a driver update misses instead of loading a stale binary
+    static void cache_path (char* path, size_t size, string& vs, string& fs)
+    {
+        uint64_t hash = fnv1a (vs.data (), vs.length);
+
+        hash = fnv1a (fs.data (), fs.length, hash);
+
+        const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+
+        for (GLenum name : names)
+        {
+            const char* str = (const char*)glGetString (name);
+
+            if (str) hash = fnv1a (str, strlen (str), hash);
+        }
+
+        char* dir = SDL_GetPrefPath ("treevi", "shaders");
+
+        snprintf (path, size, "%sprogram-%016llx.bin", dir ? dir : "",
+                  (unsigned long long)hash);
+
+        if (dir) SDL_free (dir);
+    }
+
+    static bool binaries ()
+    {
+        if (!GLEW_ARB_get_program_binary) return false;
+
+        sint formats = 0;
+        glGetIntegerv (GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+        return formats > 0;
+    }
+
+    // The file holds the binary format enum followed by the binary
+    bool load_binary (const char* path)
+    {
+        FILE* fp = fopen (path, "rb");
+
+        if (!fp) return false;
+
+        fclose (fp);
+
+        GLenum format = 0;
+        string binary = read_file (path);
+        bool   linked = false;
+
+        if (binary.length > sizeof (format))
+        {
+            memcpy (&format, binary.data (), sizeof (format));
+
+            glProgramBinary (id, format, binary.data () + sizeof (format),
+                             binary.length - sizeof (format));
+
+            sint status = 0;
+            glGetProgramiv (id, GL_LINK_STATUS, &status);
+
+            linked = (status != GL_FALSE);
+        }
+
+        binary.clean ();
+
+        return linked;
+    }
+
+    void save_binary (const char* path)
+    {
+        sint length = 0;
+        glGetProgramiv (id, GL_PROGRAM_BINARY_LENGTH, &length);
+
+        if (length <= 0) return;
+
+        GLenum format = 0;
+        char*  binary = new char[length];
+
+        glGetProgramBinary (id, length, &length, &format, binary);
+
+        FILE* fp = fopen (path, "wb");
+
+        if (fp)
+        {
+            fwrite (&format, sizeof (format), 1, fp);
+            fwrite (binary, 1, length, fp);
+            fclose (fp);
+        }
+
+        delete[] binary;
+    }
+
+    void init (const char* vs_file, const char* fs_file)
+    {
+        string vs = read_file (vs_file), fs = read_file (fs_file);
+
+        char path[1024];
+        bool binary = binaries ();
+
+        if (binary) cache_path (path, sizeof (path), vs, fs);
+
+        id       = glCreateProgram ();
+        vertex   = fragment = 0;
+        cached   = binary && load_binary (path);
+
+        if (!cached)
+        {
+            vertex   = compile (vs, GL_VERTEX_SHADER);
+            fragment = compile (fs, GL_FRAGMENT_SHADER);
+
+            glAttachShader (id, vertex);
+            glAttachShader (id, fragment);
+
+            if (binary)
+                glProgramParameteri (id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                                     GL_TRUE);
+
+            glLinkProgram (id);
+
+            sint is_linked;
+            glGetProgramiv (id, GL_LINK_STATUS, &is_linked);
+
+            assert (is_linked != false);
+
+            if (binary) save_binary (path);
+        }
+
+        vs.clean ();
+        fs.clean ();
+
+        for (int u = 0; u < UNIFORMS_COUNT; u++)
+        {
+            locations[u] = glGetUniformLocation (id, uniform_names[u]);
+            sent[u]      = false;
+        }
+
+        glUseProgram (id);
+        set (U_COLOR, Vec3 (1, 1, 0));
+        set (U_PROJECTION, ortho (W, H));
+
+        set (U_IMAGE, 0);
+        set (U_OFFSET, Vec4 (0, 0, .1, .1));
+        set (U_ALPHA, 1.f);
+
+        init_buffers ();
+    }
+
+    void init_buffers ()
+    {
+        const float points[] = {
+            0.0f, 1.0f,    //
+            1.0f, 0.0f,    //
+            0.0f, 0.0f,    //
 
             0.0f, 1.0f,    //
             1.0f, 1.0f,    //
             1.0f, 0.0f,    //
         };
 
-        glGenVertexArrays (1, &vao);
-        glGenBuffers (1, &vbo);
+        glGenVertexArrays (1, &vao);
+        glGenBuffers (1, &vbo);
+
+        glBindVertexArray (vao);
+        glBindBuffer (GL_ARRAY_BUFFER, vbo);
+
+        glVertexAttribPointer (0, 2, GL_FLOAT, GL_FALSE, 0, 0);
+        glEnableVertexAttribArray (0);
+
+        glBufferData (GL_ARRAY_BUFFER, sizeof (points), points, GL_STATIC_DRAW);
+
+        instances.init (1024 * sizeof (Instance));
+
+        for (uint i = 0; i < 4; i++)
+        {
+            glVertexAttribDivisor (i + 1, 1);
+            glEnableVertexAttribArray (i + 1);
+        }
+
+        bind_instances (0);
+    }
+
+    // Points the instance attributes at `offset` into the stream, where
+    // this frame's instances were written
+    void bind_instances (size_t offset)
+    {
+        const sint   sizes[]   = { 4, 4, 4, 2 };
+        const size_t offsets[] = {
+            offsetof (Instance, rect),
+            offsetof (Instance, color),
+            offsetof (Instance, offset),
+            offsetof (Instance, angle),
+        };
+
+        glBindBuffer (GL_ARRAY_BUFFER, instances.id);
+
+        for (uint i = 0; i < 4; i++)
+            glVertexAttribPointer (i + 1, sizes[i], GL_FLOAT, GL_FALSE,
+                                   sizeof (Instance),
+                                   (void*)(offset + offsets[i]));
+
+        gl_stats.calls += 5;
+    }
+
+    void use ()
+    {
+        glBindVertexArray (vao);
+        glUseProgram (id);
+
+        gl_stats.calls += 2;
+    }
+};
+
+namespace graphics
+{
+    Vec2 NODE_SIZE = { 16.f, 16.f };
+
+    struct Rect
+    {
+        float x0, y0, x1, y1;
+
+        void join (Rect b)
+        {
+            if (b.x0 < x0) x0 = b.x0;
+            if (b.y0 < y0) y0 = b.y0;
+            if (b.x1 > x1) x1 = b.x1;
+            if (b.y1 > y1) y1 = b.y1;
+        }
+    };
+
+    // Mirrors the tree's pool slot for slot, slot 0 stays unused
+    struct Node
+    {
+        Vec2     pos;
+        Vec2     curr;    // offset handed down by the parent, in cells
+        char     str[20];    // label, see keys::format
+        uint8_t  length;
+        uint64_t key;        // fingerprint of the key str was made from
+        float    width;      // of the label in pixels
+        uint32_t left, right;
+        int32_t  cells[4];    // grid cells it is filed under, see Grid
+        Rect     extent;      // every box in the subtree
+
+        Rect box ()
+        {
+            return { pos.x, pos.y, pos.x + width, pos.y + NODE_SIZE.y };
+        }
+    };
+
+    // Uniform grid over the node rectangles, hashed so that sparse layouts
+    // (long chains) don't pay for the empty space they span. An item is
+    // filed in every cell its rectangle touches
+    struct Grid
+    {
+        struct Cell
+        {
+            int32_t         x, y;
+            Array<uint32_t> items;
+        };
+
+        float           size;
+        Array<Cell>     cells;
+        Array<int32_t>  table;    // open addressing into cells, -1 is empty
+        Array<uint32_t> marks;    // last query that returned each item
+        uint32_t        stamp;
+
+        Grid ()
+        {
+            size  = 256;
+            stamp = 0;
+        }
+
+        static uint32_t hash (int32_t x, int32_t y)
+        {
+            return (uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u;
+        }
+
+        void rehash (size_t length)
+        {
+            table.clean ();
+            table.reserve (length);
+            table.length = length;
+
+            for (size_t i = 0; i < length; i++) table.data[i] = -1;
+
+            for (size_t i = 0; i < cells.length; i++)
+            {
+                uint32_t slot = hash (cells.data[i].x, cells.data[i].y);
+
+                while (table.data[slot & (length - 1)] != -1) slot++;
+
+                table.data[slot & (length - 1)] = i;
+            }
+        }
+
+        Cell* find (int32_t x, int32_t y, bool create)
+        {
+            if (table.length == 0) rehash (64);
+
+            uint32_t mask = table.length - 1, slot = hash (x, y);
+
+            for (;; slot++)
+            {
+                int32_t index = table.data[slot & mask];
+
+                if (index == -1) break;
+
+                Cell& cell = cells.data[index];
+
+                if (cell.x == x && cell.y == y) return &cell;
+            }
+
+            if (!create) return nullptr;
+
+            cells.push ({ x, y, Array<uint32_t> () });
+            table.data[slot & mask] = cells.length - 1;
+
+            if (cells.length * 2 > table.length) rehash (table.length * 2);
+
+            return &cells.data[cells.length - 1];
+        }
+
+        void range (Rect rect, int32_t out[4])
+        {
+            out[0] = floorf (rect.x0 / size);
+            out[1] = floorf (rect.y0 / size);
+            out[2] = floorf (rect.x1 / size);
+            out[3] = floorf (rect.y1 / size);
+        }
+
+        void insert (uint32_t item, Rect rect, int32_t filed[4])
+        {
+            range (rect, filed);
+
+            for (int32_t y = filed[1]; y <= filed[3]; y++)
+                for (int32_t x = filed[0]; x <= filed[2]; x++)
+                    find (x, y, true)->items.push (item);
+        }
+
+        void remove (uint32_t item, int32_t filed[4])
+        {
+            for (int32_t y = filed[1]; y <= filed[3]; y++)
+            {
+                for (int32_t x = filed[0]; x <= filed[2]; x++)
+                {
+                    Cell* cell = find (x, y, false);
+
+                    if (!cell) continue;
+
+                    for (size_t i = 0; i < cell->items.length; i++)
+                    {
+                        if (cell->items.data[i] != item) continue;
+
+                        cell->items.data[i] = cell->items.pop ();
+                        break;
+                    }
+                }
+            }
+
+            filed[0] = 1;
+            filed[2] = 0;
+        }
+
+        template <class F> void visit_cell (Cell& cell, F visit)
+        {
+            for (size_t i = 0; i < cell.items.length; i++)
+            {
+                uint32_t item = cell.items.data[i];
+
+                if (item >= marks.length || marks.data[item] == stamp) continue;
+
+                marks.data[item] = stamp;
+                visit (item);
+            }
+        }
+
+        // Every item whose cells overlap the view, each reported once
+        template <class F> void query (Rect view, F visit)
+        {
+            int32_t r[4];
+
+            range (view, r);
+            stamp++;
+
+            double span = (double)(r[2] - r[0] + 1) * (r[3] - r[1] + 1);
+
+            // zoomed far out the view spans more cells than exist
+            if (span > cells.length)
+            {
+                for (size_t i = 0; i < cells.length; i++)
+                {
+                    Cell& cell = cells.data[i];
+
+                    if (cell.x >= r[0] && cell.x <= r[2] && cell.y >= r[1]
+                        && cell.y <= r[3])
+                        visit_cell (cell, visit);
+                }
+
+                return;
+            }
+
+            for (int32_t y = r[1]; y <= r[3]; y++)
+            {
+                for (int32_t x = r[0]; x <= r[2]; x++)
+                {
+                    Cell* cell = find (x, y, false);
+
+                    if (cell) visit_cell (*cell, visit);
+                }
+            }
+        }
+
+        void reserve (size_t items)
+        {
+            if (items <= marks.length) return;
+
+            marks.reserve (items);
+
+            for (size_t i = marks.length; i < items; i++) marks.data[i] = 0;
+
+            marks.length = items;
+        }
+
+        void clear ()
+        {
+            for (size_t i = 0; i < cells.length; i++)
+                cells.data[i].items.clean ();
+
+            cells.length = 0;
+            table.clean ();
+        }
+    };
+
+    // Pan/zoom view over the layout, in the same pixel units as Node::pos
+    struct Camera
+    {
+        Vec2  pos;    // world position of the top-left corner
+        float zoom;
+
+        Camera () { zoom = 1; }
+
+        Rect view ()
+        {
+            return { pos.x, pos.y, pos.x + W / zoom, pos.y + H / zoom };
+        }
+
+        Mat4 projection ()
+        {
+            Rect v = view ();
+
+            return ortho (v.x0, v.x1, v.y0, v.y1);
+        }
+
+        Vec2 world (Vec2 screen) { return pos + screen / zoom; }
+
+        // Puts a world point in the middle of the window at the same zoom
+        void center (Vec2 point)
+        {
+            pos = point - Vec2 (W, H) / (2 * zoom);
+        }
+
+        void pan (Vec2 screen_delta)
+        {
+            pos = pos - screen_delta / zoom;
+        }
+
+        // Keeps the world point under the cursor in place
+        void zoom_at (Vec2 screen, float factor)
+        {
+            Vec2 anchor = world (screen);
+
+            zoom *= factor;
+            pos   = anchor - screen / zoom;
+        }
+    };
+
+    struct Glyph
+    {
+        Vec4  offset;    // uv rect inside the atlas
+        float w, h, advance;
+    };
+
+    // Every glyph packed into one texture, looked up directly by char
+    struct Atlas
+    {
+        Texture texture;
+        Glyph   glyphs[256];
+        float   scale;
+
+        void init (TTF_Font* font, char** xpm)
+        {
+            if (font) init (font);
+            else init (xpm);
+
+            // glyphs are drawn NODE_SIZE.y tall whatever their source size
+            scale = NODE_SIZE.y / glyphs[(unsigned char)'0'].h;
+        }
+
+        void init (TTF_Font* font)
+        {
+            const int first = 32, last = 126, columns = 16;
+
+            SDL_Surface* rendered[last - first + 1];
+            int          cell_w = 1, cell_h = TTF_FontHeight (font);
+
+            for (int c = first; c <= last; c++)
+            {
+                const char text[2] = { (char)c, '\0' };
+
+                rendered[c - first] = TTF_RenderText_Blended (
+                    font, text, { 255, 255, 255, 255 });
+
+                if (rendered[c - first] && rendered[c - first]->w > cell_w)
+                    cell_w = rendered[c - first]->w;
+            }
+
+            int rows = (last - first + columns) / columns;
+
+            SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat (
+                0, cell_w * columns, cell_h * rows, 32, SDL_PIXELFORMAT_RGBA32);
+
+            assert (surface != nullptr);
+
+            for (int c = first; c <= last; c++)
+            {
+                SDL_Surface* glyph = rendered[c - first];
+
+                if (!glyph) continue;
+
+                SDL_Rect rect = {
+                    ((c - first) % columns) * cell_w,
+                    ((c - first) / columns) * cell_h,
+                    glyph->w,
+                    glyph->h,
+                };
+
+                SDL_SetSurfaceBlendMode (glyph, SDL_BLENDMODE_NONE);
+                SDL_BlitSurface (glyph, nullptr, surface, &rect);
+
+                int advance = glyph->w;
+
+                TTF_GlyphMetrics (font, c, nullptr, nullptr, nullptr, nullptr,
+                                  &advance);
+
+                glyphs[c] = {
+                    {
+                        rect.x / (float)surface->w,
+                        rect.y / (float)surface->h,
+                        rect.w / (float)surface->w,
+                        rect.h / (float)surface->h,
+                    },
+                    (float)rect.w,
+                    (float)rect.h,
+                    (float)advance,
+                };
+
+                SDL_FreeSurface (glyph);
+            }
+
+            texture.init (surface);
+
+            SDL_FreeSurface (surface);
+
+            fill_missing ('?');
+        }
+
+        // font.xpm: 10x10 grid of 8px cells, a-z from the top, digits on row 4
+        void init (char** xpm)
+        {
+            texture.init (xpm);
+
+            const float cell = 8;
+
+            auto set = [&] (char c, int column, int row) {
+                glyphs[(unsigned char)c] = {
+                    { column / 10.f, row / 10.f, .1f, .1f }, cell, cell, cell
+                };
+            };
+
+            for (char c = 'a'; c <= 'z'; c++)
+                set (c, (c - 'a') % 10, (c - 'a') / 10);
+
+            for (char c = '0'; c <= '9'; c++) set (c, c - '0', 4);
+
+            set ('.', 6, 2);
+            set ('-', 7, 2);
+
+            fill_missing ('0');
+        }
+
+        void fill_missing (char fallback)
+        {
+            for (int c = 0; c < 256; c++)
+                if (glyphs[c].h == 0)
+                    glyphs[c] = glyphs[(unsigned char)fallback];
+        }
+
+        const Glyph& operator[] (char c) { return glyphs[(unsigned char)c]; }
+
+        float advance (char c)
+        {
+            return glyphs[(unsigned char)c].advance * scale;
+        }
+
+        float width (const char* str)
+        {
+            float width = 0;
+
+            for (size_t i = 0; str[i] != '\0'; i++) width += advance (str[i]);
+
+            return width;
+        }
+    };
+
+    TTF_Font*       font = nullptr;
+    Array<Node>     nodes;
+    Atlas           atlas;
+    Grid            grid;
+    Camera          camera;
+    Array<uint32_t> moved, visible;
+
+    size_t relaid = 0;    // nodes placed by the last update_nodes
+
+    int precision = 9;    // significant digits in labels, 9 keeps every float
+
+    Node* child (uint32_t index)
+    {
+        return index ? &nodes.data[index] : nullptr;
+    }
+
+    // Label text for a key, cut to fit Node::str, and a fingerprint that
+    // changes whenever the label would
+    inline int label (float key, char* str)
+    {
+        return keys::format (key, str, precision);
+    }
+
+    inline int label (const string& key, char* str)
+    {
+        int length = key.length < 19 ? key.length : 19;
+
+        memcpy (str, key.data (), length);
+        str[length] = '\0';
+
+        return length;
+    }
+
+    inline uint64_t fingerprint (float key)
+    {
+        uint32_t bits;
+
+        memcpy (&bits, &key, sizeof (bits));
+
+        return bits;
+    }
+
+    inline uint64_t fingerprint (const string& key)
+    {
+        return (uint64_t)key.hash << 32 | key.length;
+    }
+
+    // Places node i at `at` and hands its children their offsets. Only
+    // writes node i, so disjoint subtrees can be placed side by side
+    template <class Tr>
+    bool place_node (Tr& tree, uint32_t i, Vec2 at, Vec2& left, Vec2& right)
+    {
+        auto&& t_node = tree[i];    // a Frozen slot is made on the fly
+        Node&  node   = nodes.data[i];
+
+        if (!t_node.dirty && node.curr.x == at.x && node.curr.y == at.y)
+            return false;
+
+        float l_height = tree.height (t_node.left) * 3;
+
+        Vec2 pos = { at.x + l_height + 1, at.y };
+
+        // Rotations dirty a node without changing its key, the label is
+        // only redone for a slot that holds a new one
+        if (t_node.dirty
+            && (!node.length || node.key != fingerprint (t_node.data)))
+        {
+            node.key    = fingerprint (t_node.data);
+            node.length = label (t_node.data, node.str);
+            node.width  = atlas.width (node.str);
+        }
+
+        node.pos   = pos * NODE_SIZE;
+        node.curr  = at;
+        node.left  = t_node.left;
+        node.right = t_node.right;
+
+        t_node.dirty = false;
+
+        left  = { at.x, at.y + 2 };
+        right = { pos.x + 1, at.y + 2 };
+
+        return true;
+    }
+
+    // Places every dirty node and every node whose inherited offset moved.
+    // A clean node that would land where it already is keeps its whole
+    // subtree, so one insert costs the path plus what shifts right of it
+    template <class Tr>
+    void update_nodes (Tr& tree, uint32_t index, Vec2 curr = { 0, 0 })
+    {
+        relaid = 0;
+
+        tree.preorder (index, curr, [&] (uint32_t i, const Vec2& at,
+                                         Vec2& left, Vec2& right) -> bool {
+            if (!place_node (tree, i, at, left, right)) return false;
+
+            relaid++;
+            moved.push (i);
+
+            return true;
+        });
+    }
+
+    // Subtrees over this many keys are handed out as work items of their own
+    uint32_t split = 4096;
+
+    // A subtree of the parallel update_nodes: where it starts, and the
+    // slots it placed, in pre-order
+    struct Task
+    {
+        uint32_t        node;
+        Vec2            at;
+        Array<uint32_t> moved;
+    };
+
+    const uint32_t TASKS = 1024;    // past this many, subtrees stay inline
+
+    Array<Task> tasks;
+
+    // update_nodes spread over the workers. A child heavier than split
+    // keys becomes a task of its own, numbered as it is spawned, so every
+    // task comes after the one it was split from. A prefix sum over the
+    // tasks' counts gives each its offset in moved, and the tasks copy in
+    // side by side: parents still come before children, which is all the
+    // grid and extent passes after it rely on
+    template <class Tr>
+    void update_nodes (Tr& tree, uint32_t index, Vec2 curr, Workers& workers)
+    {
+        relaid = 0;
+
+        if (!index) return;
+
+        while (tasks.length < TASKS) tasks.push ({ 0, {}, Array<uint32_t> () });
+
+        std::atomic<uint32_t> spawned (1);
+
+        tasks.data[0].node = index;
+        tasks.data[0].at   = curr;
+
+        uint32_t first = 0;
+
+        workers.run (&first, 1, [&] (int worker, uint32_t id) {
+            struct Step
+            {
+                uint32_t node;
+                Vec2     at;
+            };
+
+            Task&       task = tasks.data[id];
+            Array<Step> stack;
+
+            task.moved.length = 0;
+
+            stack.push ({ task.node, task.at });
+
+            while (stack.length)
+            {
+                Step step = stack.pop ();
+                Vec2 left, right;
+
+                if (!place_node (tree, step.node, step.at, left, right))
+                    continue;
+
+                task.moved.push (step.node);
+
+                Node& node = nodes.data[step.node];
+                Step  children[]
+                    = { { node.right, right }, { node.left, left } };
+
+                for (Step& child : children)
+                {
+                    if (!child.node) continue;
+
+                    uint32_t next = TASKS;
+
+                    if (tree.weight (child.node) > split) next = spawned++;
+
+                    if (next >= TASKS)
+                    {
+                        stack.push (child);
+                        continue;
+                    }
+
+                    tasks.data[next].node = child.node;
+                    tasks.data[next].at   = child.at;
+
+                    workers.spawn (worker, next);
+                }
+            }
+
+            stack.clean ();
+        });
+
+        uint32_t        count = spawned < TASKS ? (uint32_t)spawned : TASKS;
+        Array<uint32_t> offsets, ids;
+
+        offsets.reserve (count);
+        ids.reserve (count);
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            offsets.push (relaid);
+            ids.push (i);
+
+            relaid += tasks.data[i].moved.length;
+        }
+
+        moved.reserve (relaid);
+        moved.length = relaid;
+
+        workers.run (ids.data, count, [&] (int, uint32_t id) {
+            Array<uint32_t>& part = tasks.data[id].moved;
+
+            memcpy (moved.data + offsets.data[id], part.data,
+                    part.length * sizeof (uint32_t));
+        });
+
+        offsets.clean ();
+        ids.clean ();
+    }
+
+    // Places one B-tree node with its subtree: the children left to right
+    // from `cursor`, then the node's keys side by side centred above them.
+    // Leaves advance the cursor. Recursion goes as deep as the tree
+    template <class T>
+    void place (BTree<T>& tree, uint32_t index, float y, float& cursor)
+    {
+        typename BTree<T>::Node& b_node = tree.pool.data[index];
+
+        float from = cursor, width = -2;
+
+        if (!tree.leaf (index))
+            for (uint32_t i = 0; i <= b_node.count; i++)
+                place (tree, b_node.children[i], y + 3, cursor);
+
+        for (uint32_t j = 0; j < b_node.count; j++)
+        {
+            Node& node = nodes.data[tree.slot (index, j)];
+
+            if (!node.length || node.key != fingerprint (b_node.keys[j]))
+            {
+                node.key    = fingerprint (b_node.keys[j]);
+                node.length = label (b_node.keys[j], node.str);
+                node.width  = atlas.width (node.str);
+            }
+
+            width += node.width + 2;
+        }
+
+        float x = tree.leaf (index)
+                      ? cursor
+                      : (from + cursor - NODE_SIZE.x - width) / 2;
+
+        if (tree.leaf (index)) cursor += width + NODE_SIZE.x;
+
+        for (uint32_t j = 0; j < b_node.count; j++)
+        {
+            uint32_t slot = tree.slot (index, j);
+            Node&    node = nodes.data[slot];
+
+            node.pos   = { x, y * NODE_SIZE.y };
+            node.left  = tree.left (slot);
+            node.right = tree.right (slot);
+
+            x += node.width + 2;
+
+            relaid++;
+        }
+    }
+
+    // A B-tree draws each node as a row of key boxes joined by the edges
+    // between neighbours. Splits move keys between slots, so every slot is
+    // placed again when the tree changed; the ones left empty leave the
+    // grid. moved gets the key slots in the binary view's pre-order
+    template <class T>
+    void update_nodes (BTree<T>& tree, uint32_t index, Vec2 curr = { 0, 0 })
+    {
+        relaid = 0;
+
+        for (uint32_t slot = 1; slot < tree.slots (); slot++)
+        {
+            if (tree.used (slot)) continue;
+
+            grid.remove (slot, nodes.data[slot].cells);
+
+            nodes.data[slot].length = 0;
+        }
+
+        if (!index) return;
+
+        float cursor = 0;
+
+        place (tree, tree.node_of (index), curr.y, cursor);
+
+        tree.preorder (index, [&] (uint32_t i) -> bool {
+            moved.push (i);
+            return true;
+        });
+    }
+
+    // B-tree rows are placed from a running cursor, which stays serial
+    template <class T>
+    void update_nodes (BTree<T>& tree, uint32_t index, Vec2 curr, Workers&)
+    {
+        update_nodes (tree, index, curr);
+    }
+
+    // A node is filed under its own box plus its children's, which covers
+    // the edges it draws
+    Rect bounds (Node& node)
+    {
+        Rect rect = node.box ();
+
+        if (node.left) rect.join (nodes.data[node.left].box ());
+        if (node.right) rect.join (nodes.data[node.right].box ());
+
+        return rect;
+    }
+
+    // Retained: only runs when the tree was mutated since the last call.
+    // With workers the nodes are placed in parallel
+    template <class Tr> void layout (Tr& tree, Workers* workers = nullptr)
+    {
+        if (!tree.changed) return;
+
+        size_t length = nodes.length, slots = tree.slots ();
+
+        if (slots < length)
+        {
+            grid.clear ();
+            length = 0;
+        }
+
+        if (nodes.size < slots)
+            nodes.reserve (slots < 2 * nodes.size ? 2 * nodes.size : slots);
+
+        nodes.length = slots;
+
+        for (size_t i = length; i < nodes.length; i++)
+        {
+            nodes.data[i].cells[0] = 1;
+            nodes.data[i].cells[2] = 0;
+            nodes.data[i].length   = 0;
+        }
+
+        grid.reserve (nodes.size);
+
+        moved.length = 0;
+
+        // Erased slots leave the grid, and get a fresh label when reused
+        for (uint32_t slot : tree.freed)
+        {
+            grid.remove (slot, nodes.data[slot].cells);
+
+            nodes.data[slot].length = 0;
+        }
+
+        if (workers && workers->count > 1)
+            update_nodes (tree, tree.root, { 0, 1 }, *workers);
+        else update_nodes (tree, tree.root, { 0, 1 });
+
+        // children are placed after their parent, so boxes are only final now
+        for (size_t i = 0; i < moved.length; i++)
+        {
+            Node& node = nodes.data[moved.data[i]];
+
+            grid.remove (moved.data[i], node.cells);
+            grid.insert (moved.data[i], bounds (node), node.cells);
+        }
+
+        // moved is in pre-order, walking it backwards sees children first
+        for (size_t i = moved.length; i-- > 0;)
+        {
+            Node& node = nodes.data[moved.data[i]];
+
+            node.extent = node.box ();
+
+            if (node.left) node.extent.join (nodes.data[node.left].extent);
+            if (node.right) node.extent.join (nodes.data[node.right].extent);
+        }
+
+        tree.changed = false;
+    }
+
+    // Nodes whose box or edges intersect the camera view
+    Array<uint32_t>& cull (Rect view)
+    {
+        visible.length = 0;
+
+        grid.query (view, [&] (uint32_t i) { visible.push (i); });
+
+        return visible;
+    }
+
+    bool overlaps (Rect a, Rect b)
+    {
+        return a.x0 <= b.x1 && b.x0 <= a.x1 && a.y0 <= b.y1 && b.y0 <= a.y1;
+    }
+
+    float           lod = 24;    // summary threshold in screen pixels
+    Array<uint32_t> summaries;
+
+    // Walks the subtree extents from the root: subtrees off screen are
+    // skipped, subtrees smaller than lod pixels go to summaries whole, so a
+    // zoomed-out frame costs what fits on screen rather than the tree size
+    template <class Tr>
+    Array<uint32_t>& cull (Tr& tree, Rect view, float zoom)
+    {
+        visible.length = summaries.length = 0;
+
+        tree.preorder (tree.root, [&] (uint32_t i) -> bool {
+            Node& node = nodes.data[i];
+
+            if (!overlaps (node.extent, view)) return false;
+
+            float w = (node.extent.x1 - node.extent.x0) * zoom;
+            float h = (node.extent.y1 - node.extent.y0) * zoom;
+
+            if (tree.weight (i) > 1 && w < lod && h < lod)
+            {
+                summaries.push (i);
+                return false;
+            }
+
+            if (overlaps (bounds (node), view)) visible.push (i);
+
+            return true;
+        });
+
+        return visible;
+    }
+
+    void draw_line (Shader& shader, Node* a, Node* b, Vec2 height = { 16, 16 })
+    {
+        if (!b) return;
+
+        Vec2 diff = (a->pos - b->pos) / 2.f;
+        Vec2 line = {
+            b->pos.x + (b->width / 2.f),
+            b->pos.y + (diff.y + (height.y / 2.f)),
+        };
+
+        float angle = a->pos.angle (line);
+
+        shader.set (U_TYPE, 0);
+        shader.set (U_ALPHA, 1.f);
+        shader.set (U_COLOR, Vec3 (0, .4, 1));
+
+        shader.set (U_MODEL, get_model (line, { diff.x * 2, 2 }, angle));
+        glDrawArrays (GL_TRIANGLES, 0, 6);
+        gl_stats.draw ();
+    }
+
+    void draw (Shader& shader, Node* a)
+    {
+        if (!a) return;
+
+        draw_line (shader, a, child (a->left));
+        draw_line (shader, a, child (a->right));
+
+        shader.set (U_TYPE, 0);
+        shader.set (U_COLOR, Vec3 (0.8f, .2f, 0.f));
+        shader.set (U_ALPHA, 1.f);
+
+        Vec2 pos        = a->pos;
+        Vec2 block_size = { a->width, NODE_SIZE.y };
+
+        shader.set (U_MODEL, get_model (pos, block_size, 0));
+        glDrawArrays (GL_TRIANGLES, 0, 6);
+        gl_stats.draw ();
+
+        shader.set (U_TYPE, 1);
+
+        for (size_t j = 0; j < a->length; j++)
+        {
+            const Glyph& glyph = atlas[a->str[j]];
+
+            Vec2 size = { glyph.w * atlas.scale, glyph.h * atlas.scale };
+
+            shader.set (U_OFFSET, glyph.offset);
+            shader.set (U_MODEL, get_model (pos, size, 0));
+            glDrawArrays (GL_TRIANGLES, 0, 6);
+            gl_stats.draw ();
+
+            pos.x += atlas.advance (a->str[j]);
+        }
+    }
+
+    void draw (Shader& shader, Array<Node>& nodes)
+    {
+        for (size_t i = 1; i < nodes.length; i++) draw (shader, &nodes.data[i]);
+    }
+
+    // Collects every edge, box and glyph of a frame into one instance buffer
+    // so the whole tree goes out in a single glDrawArraysInstanced
+    struct Batch
+    {
+        Array<Instance> edges, boxes, glyphs;
+
+        static Instance make (Vec2 pos, Vec2 size, Vec4 color, float angle = 0,
+                              float type = 0, Vec4 offset = {})
+        {
+            return {
+                { pos.x, pos.y, size.x, size.y }, color, offset, angle, type
+            };
+        }
+
+        void push_line (Node* a, Node* b, Vec2 height = { 16, 16 })
+        {
+            if (!b) return;
+
+            Vec2 diff = (a->pos - b->pos) / 2.f;
+            Vec2 line = {
+                b->pos.x + (b->width / 2.f),
+                b->pos.y + (diff.y + (height.y / 2.f)),
+            };
+
+            float angle = a->pos.angle (line);
+
+            edges.push (make (line, { diff.x * 2, 2 }, { 0, .4, 1, 1 }, angle));
+        }
+
+        void push (Node* a)
+        {
+            if (!a) return;
+
+            push_line (a, child (a->left));
+            push_line (a, child (a->right));
+
+            Vec2 pos = a->pos;
+
+            boxes.push (make (pos, { a->width, NODE_SIZE.y },
+                              { 0.8f, .2f, 0.f, 1.f }));
+
+            for (size_t j = 0; j < a->length; j++)
+            {
+                const Glyph& glyph = atlas[a->str[j]];
+
+                Vec2 size = { glyph.w * atlas.scale, glyph.h * atlas.scale };
+
+                glyphs.push (
+                    make (pos, size, { 1, 1, 1, 1 }, 0, 1, glyph.offset));
+
+                pos.x += atlas.advance (a->str[j]);
+            }
+        }
+
+        void push (Array<Node>& nodes)
+        {
+            for (size_t i = 1; i < nodes.length; i++) push (&nodes.data[i]);
+        }
+
+        void push (Array<Node>& nodes, Array<uint32_t>& subset)
+        {
+            for (size_t i = 0; i < subset.length; i++)
+                push (&nodes.data[subset.data[i]]);
+        }
+
+        // One box over the whole subtree, labelled "count: min..max" and
+        // shrunk to fit; the label is dropped once it would be unreadable
+        template <class TrNode>
+        void push_summary (Node& node, const TrNode& t_node, float zoom)
+        {
+            Rect e = node.extent;
+
+            boxes.push (make ({ e.x0, e.y0 }, { e.x1 - e.x0, e.y1 - e.y0 },
+                              { 0.8f, .2f, 0.f, .5f }));
+
+            char str[64], min[20], max[20];
+
+            label (t_node.min, min);
+            label (t_node.max, max);
+
+            sprintf (str, "%u: %s..%s", t_node.weight, min, max);
+
+            float width = atlas.width (str);
+            float scale = (e.x1 - e.x0) / width;
+
+            if (scale > 1) scale = 1;
+            if (scale * NODE_SIZE.y * zoom < 4) return;
+
+            Vec2 pos = { e.x0, e.y0 };
+
+            for (size_t j = 0; str[j] != '\0'; j++)
+            {
+                const Glyph& glyph = atlas[str[j]];
+
+                Vec2 size = { glyph.w * atlas.scale * scale,
+                              glyph.h * atlas.scale * scale };
+
+                glyphs.push (
+                    make (pos, size, { 1, 1, 1, 1 }, 0, 1, glyph.offset));
+
+                pos.x += atlas.advance (str[j]) * scale;
+            }
+        }
+
+        template <class Tr>
+        void push_summaries (Tr& tree, Array<Node>& nodes,
+                             Array<uint32_t>& subset, float zoom)
+        {
+            for (size_t i = 0; i < subset.length; i++)
+                push_summary (nodes.data[subset.data[i]], tree[subset.data[i]],
+                              zoom);
+        }
+
+        size_t length () { return edges.length + boxes.length + glyphs.length; }
+
+        void clear () { edges.length = boxes.length = glyphs.length = 0; }
+
+        Array<Instance>& pass (int i)
+        {
+            return i == 0 ? edges : i == 1 ? boxes : glyphs;
+        }
+
+        // Edges, then boxes, then glyphs: blending keeps painter's order
+        void flush (Shader& shader) { flush (shader, this, 1); }
+
+        // Batches filled side by side go out pass by pass, so every part's
+        // edges still land under every part's boxes
+        static void flush (Shader& shader, Batch* parts, size_t length)
+        {
+            size_t count = 0;
+
+            for (size_t i = 0; i < length; i++) count += parts[i].length ();
+
+            if (count == 0) return;
+
+            size_t    offset;
+            Instance* out = (Instance*)shader.instances.begin (
+                count * sizeof (Instance), offset);
+
+            for (int pass = 0; pass < 3; pass++)
+            {
+                for (size_t i = 0; i < length; i++)
+                {
+                    Array<Instance>& part = parts[i].pass (pass);
+
+                    if (part.length == 0) continue;
+
+                    memcpy (out, part.data, part.length * sizeof (Instance));
+
+                    out += part.length;
+                }
+            }
+
+            shader.instances.end ();
+            shader.bind_instances (offset);
+
+            shader.set (U_INSTANCED, 1);
+            glDrawArraysInstanced (GL_TRIANGLES, 0, 6, count);
+            gl_stats.draw ();
+            shader.set (U_INSTANCED, 0);
+
+            shader.instances.next ();
+
+            for (size_t i = 0; i < length; i++) parts[i].clear ();
+        }
+    };
+
+    Batch batch;
+
+    // What one frame draws: a batch per worker, filled by whoever builds
+    // the frame, and the camera it was culled with, copied when the frame
+    // was asked for so panning meanwhile can't tear it
+    struct Frame
+    {
+        Array<Batch> parts;
+        Camera       view;
+        float        lod;           // graphics::lod when it was asked for
+        uint32_t     drawn;         // keys in the live copy it shows
+        Uint64       asked, built;  // performance counter
+    };
+
+    // cull (tree, view, zoom) and the pushes after it spread over the
+    // workers. Each walks its subtree into its own batch and spawns the
+    // heavy children, so idle workers steal the big pieces near the root
+    template <class Tr> void fill (Tr& tree, Frame& out, Workers& workers)
+    {
+        Rect     view = out.view.view ();
+        float    zoom = out.view.zoom;
+        uint32_t root = tree.root;
+
+        if (!root) return;
+
+        workers.run (&root, 1, [&] (int worker, uint32_t top) {
+            Batch&          batch = out.parts.data[worker];
+            Array<uint32_t> stack;
+
+            stack.push (top);
+
+            while (stack.length)
+            {
+                uint32_t i    = stack.pop ();
+                Node&    node = nodes.data[i];
+
+                if (!overlaps (node.extent, view)) continue;
+
+                float w = (node.extent.x1 - node.extent.x0) * zoom;
+                float h = (node.extent.y1 - node.extent.y0) * zoom;
+
+                if (tree.weight (i) > 1 && w < out.lod && h < out.lod)
+                {
+                    batch.push_summary (node, tree[i], zoom);
+                    continue;
+                }
+
+                if (overlaps (bounds (node), view)) batch.push (&node);
+
+                for (uint32_t child : { node.right, node.left })
+                {
+                    if (!child) continue;
+
+                    if (tree.weight (child) <= split) stack.push (child);
+                    else workers.spawn (worker, child);
+                }
+            }
+
+            stack.clean ();
+        });
+    }
+
+    // Lays out whichever tree is shown and fills the frame with what its
+    // camera sees
+    template <class Tr> void frame (Tr& tree, Frame& out, Workers& workers)
+    {
+        layout (tree, &workers);
+
+        if (out.lod > 0) fill (tree, out, workers);
+        else out.parts.data[0].push (nodes, cull (out.view.view ()));
+    }
+
+    // Frames move through two stages: the build stage lays the tree out and
+    // fills the batches on the workers, the main thread, which owns GL, only
+    // submits them. Frames go to the build stage and come back on lock-free
+    // rings, so frame N + 1 is built while frame N is drawn. Without a
+    // build stage request builds in place and nothing overlaps
+    struct Pipeline
+    {
+        Frame                        frames[3];
+        Array<Frame*>                idle;         // main thread only
+        int                          in_flight;    // asked, not yet taken
+        Spsc<Frame*, 4>              asked, built;
+        Signal                       asked_signal, built_signal;
+        Workers                      workers;
+        std::function<void (Frame&)> build;
+        std::thread                  stage;
+        bool                         threaded;
+
+        template <class F> void start (int threads, bool pipelined, F f)
+        {
+            build     = f;
+            threaded  = pipelined;
+            in_flight = 0;
+
+            workers.start (threads);
+
+            for (Frame& frame : frames)
+            {
+                for (int i = 0; i < workers.count; i++)
+                    frame.parts.push (Batch ());
+
+                idle.push (&frame);
+            }
+
+            if (!threaded) return;
+
+            // A signal without a frame behind it is finish asking to stop
+            stage = std::thread ([this] () {
+                Frame* frame = nullptr;
+
+                for (;;)
+                {
+                    asked_signal.wait ();
+
+                    if (!asked.pop (frame)) return;
+
+                    run (*frame);
+                    built.push (frame);
+                    built_signal.post ();
+                }
+            });
+        }
+
+        void run (Frame& frame)
+        {
+            build (frame);
+
+            frame.built = SDL_GetPerformanceCounter ();
+        }
+
+        void request (const Camera& camera)
+        {
+            Frame* frame = idle.pop ();
+
+            frame->view  = camera;
+            frame->lod   = lod;
+            frame->asked = SDL_GetPerformanceCounter ();
+
+            in_flight++;
+
+            if (!threaded)
+            {
+                run (*frame);
+                built.push (frame);
+                return;
+            }
+
+            asked.push (frame);
+            asked_signal.post ();
+        }
+
+        // The oldest frame asked for, once it is built
+        Frame& take ()
+        {
+            Frame* frame = nullptr;
+
+            if (threaded) built_signal.wait ();
+
+            built.pop (frame);
+            in_flight--;
+
+            return *frame;
+        }
+
+        void submit (Shader& shader, Frame& frame)
+        {
+            shader.set (U_PROJECTION, frame.view.projection ());
+
+            Batch::flush (shader, frame.parts.data, frame.parts.length);
+
+            idle.push (&frame);
+        }
+
+        // Puts a frame taken but not submitted back for reuse
+        void recycle (Frame& frame)
+        {
+            for (Batch& part : frame.parts) part.clear ();
+
+            idle.push (&frame);
+        }
+
+        // Throws away the frames in flight, after which the tree is the
+        // caller's until the next request
+        void drain ()
+        {
+            while (in_flight) recycle (take ());
+        }
+
+        void finish ()
+        {
+            drain ();
+
+            if (threaded)
+            {
+                asked_signal.post ();
+                stage.join ();
+            }
+
+            workers.finish ();
+
+            for (Frame& frame : frames)
+            {
+                for (Batch& part : frame.parts)
+                {
+                    part.edges.clean ();
+                    part.boxes.clean ();
+                    part.glyphs.clean ();
+                }
+
+                frame.parts.clean ();
+            }
+
+            idle.clean ();
+        }
+    };
+}
+
+namespace bench
+{
+    double now ()
+    {
+        return SDL_GetPerformanceCounter ()
+               / (double)SDL_GetPerformanceFrequency ();
+    }
+
+    // Seconds of CPU the process has used, user and system
+    double cpu ()
+    {
+#ifndef _WIN32
+        rusage usage;
+
+        getrusage (RUSAGE_SELF, &usage);
+
+        return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+               + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#else
+        return clock () / (double)CLOCKS_PER_SEC;
+#endif
+    }
+
+    Tree<float> random_tree (size_t count)
+    {
+        Tree<float> tree;
+
+        srand (count);
+
+        for (size_t i = 0; i < count; i++) tree.push (rand () % (count * 10));
+
+        return tree;
+    }
+
+    // The layout as it was before heights were cached on Tree::Node, the
+    // call counter also keeps the compiler from folding the repeated calls
+    size_t height_calls = 0;
+
+    int recursive_height (Tree<float>& tree, Tree<float>::Index node, int i)
+    {
+        height_calls++;
+
+        if (!node) return i - 1;
+
+        if (recursive_height (tree, tree[node].left, i + 1)
+            > recursive_height (tree, tree[node].right, i + 1))
+            return recursive_height (tree, tree[node].left, i + 1);
+        else return recursive_height (tree, tree[node].right, i + 1);
+    }
+
+    size_t recursive_layout (Tree<float>& tree, Tree<float>::Index index,
+                             Vec2 curr)
+    {
+        if (!index) return 0;
+
+        Tree<float>::Node& t_node = tree[index];
+
+        float l_height = recursive_height (tree, t_node.left, 1) * 3;
+
+        Vec2 pos = { curr.x + l_height + 1, curr.y };
+
+        return 1
+               + recursive_layout (tree, t_node.left, { curr.x, curr.y + 2 })
+               + recursive_layout (tree, t_node.right,
+                                   { pos.x + 1, curr.y + 2 });
+    }
+
+    // Layout time of a degenerate left chain (descending input) by depth
+    void layout ()
+    {
+        printf ("%8s %14s %14s %14s\n", "depth", "height calls", "recursive ms",
+                "cached ms");
+
+        const int depths[] = { 4, 8, 12, 16, 20, 24, 28, 1000, 10000 };
+
+        for (int depth : depths)
+        {
+            Tree<float> tree;
+
+            for (int i = depth; i > 0; i--) tree.push (i);
+
+            double before = -1;
+
+            height_calls = 0;
+
+            if (depth <= 28)
+            {
+                double start = now ();
+                size_t count = recursive_layout (tree, tree.root, { 0, 1 });
+                before = (now () - start) * 1000.0;
+
+                assert (count == (size_t)depth);
+            }
+
+            double start = now ();
+
+            graphics::layout (tree);
+
+            double after = (now () - start) * 1000.0;
+
+            if (before < 0)
+                printf ("%8d %14s %14s %14.3f\n", depth, "-", "-", after);
+            else
+                printf ("%8d %14zu %14.3f %14.3f\n", depth, height_calls,
+                        before, after);
+        }
+
+        graphics::nodes.length = 0;
+        graphics::grid.clear ();
+    }
+
+    enum STREAMS
+    {
+        RANDOM,
+        SORTED,
+        ZIGZAG,
+    };
+
+    Array<float> stream (int order, size_t count)
+    {
+        Array<float> keys;
+
+        srand (count);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            switch (order)
+            {
+                case RANDOM: keys.push (rand ()); break;
+                case SORTED: keys.push (i); break;
+                case ZIGZAG:
+                    keys.push ((i % 2) ? count - 1 - i / 2 : i / 2);
+                    break;
+            }
+        }
+
+        return keys;
+    }
+
+    template <class Balance>
+    void insert (const char* policy, const char* order, Array<float> keys,
+                 size_t count)
+    {
+        Tree<float, Balance> tree;
+
+        double start = now ();
+
+        for (size_t i = 0; i < count; i++) tree.push (keys.data[i]);
+
+        double time = now () - start;
+
+        printf ("%-10s %-8s %9zu %14.0f %8d\n", policy, order, count,
+                count / time, tree.height ());
+
+        tree.clean ();
+    }
+
+    // Insert throughput and final height of every policy per key order.
+    // The unbalanced tree degenerates on ordered input, so it only gets a
+    // slice of those streams
+    void balance (size_t count)
+    {
+        const char*  names[]  = { "random", "sorted", "zigzag" };
+        const size_t degenerate = 20000;
+
+        printf ("%-10s %-8s %9s %14s %8s\n", "policy", "order", "keys",
+                "inserts/s", "height");
+
+        for (int order = RANDOM; order <= ZIGZAG; order++)
+        {
+            Array<float> keys = stream (order, count);
+
+            insert<balance::None> (
+                "none", names[order], keys,
+                (order == RANDOM || count < degenerate) ? count : degenerate);
+            insert<balance::AVL> ("avl", names[order], keys, count);
+            insert<balance::RedBlack> ("red-black", names[order], keys, count);
+
+            keys.clean ();
+        }
+    }
+
+    // Cost of a full layout, an unchanged frame and a frame after each of a
+    // few single inserts into a random tree
+    void incremental (size_t count)
+    {
+        Tree<float> tree = random_tree (count);
+
+        double start = now ();
+        graphics::layout (tree);
+
+        printf ("full      %10.3f ms %9zu nodes\n", (now () - start) * 1000.0,
+                graphics::relaid);
+
+        start = now ();
+        graphics::layout (tree);
+
+        printf ("unchanged %10.3f ms\n", (now () - start) * 1000.0);
+
+        for (int i = 0; i < 5; i++)
+        {
+            tree.push (rand () % (count * 10));
+
+            start = now ();
+            graphics::layout (tree);
+
+            printf ("insert    %10.3f ms %9zu nodes\n",
+                    (now () - start) * 1000.0, graphics::relaid);
+        }
+
+        tree.clean ();
+        graphics::nodes.length = 0;
+        graphics::grid.clear ();
+    }
+
+    // Batch fill for the culled set against the whole tree, per zoom level
+    void cull (size_t count)
+    {
+        Tree<float> tree = random_tree (count);
+
+        graphics::layout (tree);
+
+        graphics::Camera camera;
+        graphics::Node&  root = graphics::nodes.data[tree.root];
+
+        printf ("%8s %10s %12s %12s\n", "zoom", "visible", "culled ms",
+                "all ms");
+
+        for (float zoom = 1; zoom >= 0.0001f; zoom /= 10)
+        {
+            camera.zoom = zoom;
+            camera.pos  = root.pos - Vec2 (W, H) / (2 * zoom);
+
+            double start = now ();
+
+            graphics::batch.push (graphics::nodes,
+                                  graphics::cull (camera.view ()));
+
+            double culled = (now () - start) * 1000.0;
+
+            graphics::batch.clear ();
+
+            start = now ();
+            graphics::batch.push (graphics::nodes);
+
+            double all = (now () - start) * 1000.0;
+
+            graphics::batch.clear ();
+
+            printf ("%8g %10zu %12.3f %12.3f\n", zoom,
+                    graphics::visible.length, culled, all);
+        }
+
+        tree.clean ();
+    }
+
+    // Zoomed-out frames with and without summaries
+    void lod (size_t count)
+    {
+        Tree<float> tree = random_tree (count);
+
+        graphics::layout (tree);
+
+        graphics::Camera camera;
+        graphics::Node&  root = graphics::nodes.data[tree.root];
+
+        printf ("%8s %10s %10s %12s %10s %12s\n", "zoom", "visible",
+                "summaries", "lod ms", "grid", "grid ms");
+
+        for (float zoom = 1; zoom >= 0.0001f; zoom /= 10)
+        {
+            camera.zoom = zoom;
+            camera.pos  = root.pos - Vec2 (W, H) / (2 * zoom);
+
+            double start = now ();
+
+            graphics::cull (tree, camera.view (), zoom);
+            graphics::batch.push (graphics::nodes, graphics::visible);
+            graphics::batch.push_summaries (tree, graphics::nodes,
+                                            graphics::summaries, zoom);
+
+            double lod     = (now () - start) * 1000.0;
+            size_t visible = graphics::visible.length;
+
+            graphics::batch.clear ();
+
+            start = now ();
+            graphics::batch.push (graphics::nodes,
+                                  graphics::cull (camera.view ()));
+
+            double grid = (now () - start) * 1000.0;
+
+            graphics::batch.clear ();
+
+            printf ("%8g %10zu %10zu %12.3f %10zu %12.3f\n", zoom, visible,
+                    graphics::summaries.length, lod, graphics::visible.length,
+                    grid);
+        }
+
+        tree.clean ();
+    }
+
+    // get_model as it was: four 4x4 products with the scalar triple loop
+    Mat4 legacy_mul (Mat4 m1, Mat4 m2)
+    {
+        Mat4 result;
+
+        for (int i = 0; i < 4; i++)
+            for (int j = 0; j < 4; j++)
+            {
+                float val = 0;
+
+                for (int k = 0; k < 4; k++) val += m1[i][k] * m2[k][j];
+
+                result[i][j] = val;
+            }
+
+        return result;
+    }
+
+    Mat4 legacy_model (Vec2 pos, Vec2 size, float angle)
+    {
+        Mat4 matrix = identity (), step = identity ();
+
+        step[0][3] = pos.x + size.x * 0.5f;
+        step[1][3] = pos.y + size.y * 0.5f;
+        matrix     = legacy_mul (matrix, step);
+
+        angle = angle * (3.1415f / 180.f);
+        step  = identity ();
+
+        step[0][0] = cos (angle);
+        step[0][1] = -sin (angle);
+        step[1][0] = sin (angle);
+        step[1][1] = cos (angle);
+        matrix     = legacy_mul (matrix, step);
+
+        step       = identity ();
+        step[0][3] = -size.x * 0.5f;
+        step[1][3] = -size.y * 0.5f;
+        matrix     = legacy_mul (matrix, step);
+
+        step       = identity ();
+        step[0][0] = size.x;
+        step[1][1] = size.y;
+
+        return legacy_mul (matrix, step);
+    }
+
+    void math (size_t count)
+    {
+        Vec2  size = { 48, 16 };
+        float sum[2] = { 0, 0 };
+
+        for (size_t i = 0; i < 1000; i++)
+        {
+            Vec2  pos   = { (float)i, (float)(i % 7) };
+            float angle = i % 90;
+            Mat4  a     = legacy_model (pos, size, angle);
+            Mat4  b     = get_model (pos, size, angle);
+
+            for (int r = 0; r < 4; r++)
+                for (int c = 0; c < 4; c++)
+                    assert (fabsf (a[r][c] - b[r][c]) < 1e-2f);
+        }
+
+        double times[2];
+
+        for (int mode = 0; mode < 2; mode++)
+        {
+            double start = now ();
+
+            for (size_t i = 0; i < count; i++)
+            {
+                Vec2  pos   = { (float)i, (float)(i & 7) };
+                float angle = (i & 1) ? 0 : 30;
+                Mat4  m     = mode ? get_model (pos, size, angle)
+                                   : legacy_model (pos, size, angle);
+
+                sum[mode] += m[0][3] + m[1][0];
+            }
+
+            times[mode] = now () - start;
+        }
+
+        printf ("get_model: legacy %.1f M/s, direct %.1f M/s (%g %g)\n",
+                count / times[0] / 1e6, count / times[1] / 1e6, sum[0], sum[1]);
+
+        Mat4 m = identity ();
+
+        double start = now ();
+
+        for (size_t i = 0; i < count; i++)
+            m = mul (m, get_model ({ 1, 1 }, { 1, 1 }));
+
+        printf ("mul: %.1f M/s (%g)\n", count / (now () - start) / 1e6,
+                m[0][3]);
+    }
+
+    // Tree::Node as it was before the pool: one new per node, pointer links
+    struct PointerNode
+    {
+        float        data;
+        int          weight, height;
+        bool         red;
+        PointerNode *left, *right;
+    };
+
+    PointerNode* pointer_push (float data, PointerNode* leaf)
+    {
+        if (!leaf)
+            return new PointerNode { data, 1, 1, true, nullptr, nullptr };
+
+        if (data < leaf->data) leaf->left = pointer_push (data, leaf->left);
+        else leaf->right = pointer_push (data, leaf->right);
+
+        return leaf;
+    }
+
+    double pointer_sum (PointerNode* node)
+    {
+        if (!node) return 0;
+
+        return node->data + pointer_sum (node->left)
+               + pointer_sum (node->right);
+    }
+
+    void pointer_clean (PointerNode* node)
+    {
+        if (!node) return;
+
+        pointer_clean (node->left);
+        pointer_clean (node->right);
+
+        delete node;
+    }
+
+    double pool_sum (Tree<float>& tree, Tree<float>::Index node)
+    {
+        if (!node) return 0;
+
+        return tree[node].data + pool_sum (tree, tree[node].left)
+               + pool_sum (tree, tree[node].right);
+    }
+
+    // Bytes per node and pre-order traversal time of the pointer layout
+    // against the pool, before and after compaction
+    void arena (size_t count)
+    {
+        Array<float> keys = stream (RANDOM, count);
+
+        PointerNode* pointer = nullptr;
+        Tree<float>  tree;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            pointer = pointer_push (keys.data[i], pointer);
+            tree.push (keys.data[i]);
+        }
+
+        keys.clean ();
+
+        printf ("%zu keys, height %d\n", count, tree.height ());
+        printf ("%-16s %8s %12s\n", "layout", "bytes", "traverse ms");
+
+        double start = now (), sum = pointer_sum (pointer);
+
+        printf ("%-16s %8zu %12.3f\n", "pointer", sizeof (PointerNode),
+                (now () - start) * 1000.0);
+
+        start = now ();
+
+        double pooled = pool_sum (tree, tree.root);
+        double ms     = (now () - start) * 1000.0;
+
+        assert (pooled == sum);
+
+        printf ("%-16s %8zu %12.3f\n", "pool", sizeof (Tree<float>::Node), ms);
+
+        tree.compact ();
+
+        start  = now ();
+        pooled = pool_sum (tree, tree.root);
+        ms     = (now () - start) * 1000.0;
+
+        assert (pooled == sum);
+
+        printf ("%-16s %8zu %12.3f\n", "pool compacted",
+                sizeof (Tree<float>::Node), ms);
+
+        double iterative = 0;
+
+        start = now ();
+        tree.preorder (tree.root, [&] (Tree<float>::Index node) {
+            iterative += tree[node].data;
+            return true;
+        });
+        assert (iterative == sum);
+
+        printf ("%-16s %8zu %12.3f\n", "pool preorder",
+                sizeof (Tree<float>::Node), (now () - start) * 1000.0);
+
+        pointer_clean (pointer);
+        tree.clean ();
+    }
+
+    // One timed build of `keys`, pushing them when threads is 0
+    template <class Balance>
+    void build (const char* method, Array<float> keys, int threads)
+    {
+        Tree<float, Balance> tree;
+
+        double start = now ();
+
+        if (threads) tree.build (keys, threads);
+        else
+            for (size_t i = 0; i < keys.length; i++) tree.push (keys.data[i]);
+
+        double time = now () - start;
+
+        printf ("%-18s %7d %12.3f %8d\n", method, threads, time * 1000.0,
+                tree.height ());
+
+        tree.clean ();
+    }
+
+    // Bulk build from random and already sorted keys against one push per
+    // key, on one thread and on every core
+    void build (size_t count)
+    {
+        int cores = std::thread::hardware_concurrency ();
+
+        if (cores < 1) cores = 1;
+
+        Array<float> random = stream (RANDOM, count);
+        Array<float> sorted = stream (SORTED, count);
+
+        printf ("%zu keys, %d cores\n", count, cores);
+        printf ("%-18s %7s %12s %8s\n", "method", "threads", "ms", "height");
+
+        build<balance::None> ("push", random, 0);
+        build<balance::AVL> ("push avl", random, 0);
+        build<balance::RedBlack> ("push red-black", random, 0);
+        build<balance::None> ("build random", random, 1);
+        build<balance::None> ("build random", random, cores);
+        build<balance::None> ("build sorted", sorted, 1);
+        build<balance::None> ("build sorted", sorted, cores);
+
+        random.clean ();
+        sorted.clean ();
+    }
+
+    // Per-query cost of the order statistics on a bulk-built tree, then
+    // of erasing a tenth of the keys from a red-black one, against
+    // counting the same ranks by walking the keys in order
+    void order (size_t count)
+    {
+        Array<float> random = stream (RANDOM, count);
+
+        Tree<float, balance::RedBlack> tree;
+
+        tree.build (random);
+
+        size_t   queries = count < 1000000 ? count : 1000000;
+        uint32_t size    = tree[tree.root].weight;
+        double   check   = 0;
+
+        printf ("%zu keys, %zu queries\n", count, queries);
+        printf ("%-18s %12s %12s\n", "operation", "ms", "ns/query");
+
+        auto report = [&] (const char* name, double start, size_t n) {
+            double time = now () - start;
+
+            printf ("%-18s %12.3f %12.1f\n", name, time * 1000.0,
+                    time * 1e9 / n);
+        };
+
+        double start = now ();
+
+        for (size_t i = 0; i < queries; i++)
+            check += tree.find (random.data[i]);
+
+        report ("find", start, queries);
+
+        start = now ();
+
+        for (size_t i = 0; i < queries; i++)
+            check += tree.rank (random.data[i]);
+
+        report ("rank", start, queries);
+
+        start = now ();
+
+        for (size_t i = 0; i < queries; i++)
+            check += tree.select ((uint32_t)(i * 2654435761u % size));
+
+        report ("select", start, queries);
+
+        start = now ();
+
+        for (size_t i = 0; i + 1 < queries; i += 2)
+            check += tree.count_range (random.data[i], random.data[i + 1]);
+
+        report ("count_range", start, queries / 2);
+
+        // The linear answer to rank: walk in order up to the key
+        size_t scans = queries < 100 ? queries : 100;
+
+        start = now ();
+
+        auto last = tree.end ();
+
+        for (size_t i = 0; i < scans; i++)
+        {
+            uint32_t k = 0;
+
+            for (auto it = tree.begin (); it != last && *it < random.data[i];
+                 ++it)
+                k++;
+
+            check += k;
+        }
+
+        report ("rank by scan", start, scans);
+
+        size_t erases = count / 10;
+
+        start = now ();
+
+        for (size_t i = 0; i < erases; i++) tree.erase (random.data[i]);
+
+        report ("erase", start, erases);
+
+        printf ("height %d after erase, %u keys (%g)\n", tree.height (),
+                tree[tree.root].weight, check);
+
+        tree.clean ();
+        random.clean ();
+    }
+
+    // Lookups per second in the bulk-built pointer tree, its frozen
+    // snapshot and a binary search over the sorted keys, at each power of
+    // ten from 10^6 keys up to `count`. Half the queries miss
+    void frozen (size_t count)
+    {
+        size_t queries = 10000000;
+
+        printf ("%-10s %-16s %12s %12s\n", "keys", "method", "ms",
+                "Mlookups/s");
+
+        for (size_t n = 1000000; n <= count; n *= 10)
+        {
+            Array<float> random = stream (RANDOM, n);
+            Array<float> probes;
+
+            probes.reserve (queries);
+
+            for (size_t i = 0; i < queries; i++)
+                probes.push (i & 1 ? random.data[rand () % n]
+                                   : random.data[rand () % n] + 0.5f);
+
+            Tree<float> tree;
+
+            tree.build (random);
+
+            Frozen<float> frozen = tree.freeze ();
+
+            std::sort (random.data, random.data + n);
+
+            size_t found[3] = { 0, 0, 0 };
+
+            auto report = [&] (const char* method, double start) {
+                double time = now () - start;
+
+                printf ("%-10zu %-16s %12.3f %12.2f\n", n, method,
+                        time * 1000.0, queries / time / 1e6);
+            };
+
+            double start = now ();
+
+            for (size_t i = 0; i < queries; i++)
+                found[0] += tree.find (probes.data[i]) != 0;
+
+            report ("pointer tree", start);
+
+            start = now ();
+
+            for (size_t i = 0; i < queries; i++)
+                found[1] += frozen.find (probes.data[i]) != 0;
+
+            report ("frozen", start);
+
+            start = now ();
+
+            for (size_t i = 0; i < queries; i++)
+                found[2] += std::binary_search (random.data, random.data + n,
+                                                probes.data[i]);
+
+            report ("sorted array", start);
+
+            assert (found[0] == found[1] && found[1] == found[2]);
+
+            printf ("%-10zu %-16s %12.1f %12.1f\n", n, "bytes/key",
+                    (double)tree.pool.length * sizeof (Tree<float>::Node) / n,
+                    (double)frozen.keys.length * sizeof (float) / n);
+
+            frozen.clean ();
+            tree.clean ();
+            probes.clean ();
+            random.clean ();
+        }
+    }
+
+    // The same random keys in the binary tree and the B-tree: one push
+    // per key and the bulk build, then lookups in each built tree, half
+    // of them misses
+    void btree (size_t count)
+    {
+        size_t queries = 10000000;
+
+        Array<float> random = stream (RANDOM, count);
+        Array<float> probes;
+
+        probes.reserve (queries);
+
+        for (size_t i = 0; i < queries; i++)
+            probes.push (i & 1 ? random.data[rand () % count]
+                               : random.data[rand () % count] + 0.5f);
+
+        printf ("%zu keys, %zu lookups, %d keys per B-tree node\n", count,
+                queries, BTree<float>::KEYS);
+        printf ("%-22s %12s %12s %8s\n", "operation", "ms", "Mops/s",
+                "height");
+
+        auto report = [&] (const char* name, double start, size_t n,
+                           int height) {
+            double time = now () - start;
+
+            printf ("%-22s %12.3f %12.2f %8d\n", name, time * 1000.0,
+                    n / time / 1e6, height);
+        };
+
+        Tree<float, balance::RedBlack> binary;
+        BTree<float>                   wide;
+
+        double start = now ();
+
+        for (size_t i = 0; i < count; i++) binary.push (random.data[i]);
+
+        report ("push red-black", start, count, binary.height ());
+
+        start = now ();
+
+        for (size_t i = 0; i < count; i++) wide.push (random.data[i]);
+
+        report ("push b-tree", start, count, wide.height ());
+
+        start = now ();
+
+        binary.build (random);
+
+        report ("build binary", start, count, binary.height ());
+
+        start = now ();
+
+        wide.build (random);
+
+        report ("build b-tree", start, count, wide.height ());
+
+        size_t found[2] = { 0, 0 };
+
+        start = now ();
+
+        for (size_t i = 0; i < queries; i++)
+            found[0] += binary.find (probes.data[i]) != 0;
+
+        report ("find binary", start, queries, binary.height ());
+
+        start = now ();
+
+        for (size_t i = 0; i < queries; i++)
+            found[1] += wide.find (probes.data[i]) != 0;
+
+        report ("find b-tree", start, queries, wide.height ());
+
+        assert (found[0] == found[1]);
+
+        printf ("%-22s %12.1f %12.1f\n", "bytes/key binary, b-tree",
+                (double)binary.pool.length * sizeof (binary.pool.data[0])
+                    / count,
+                (double)wide.pool.length
+                    * (sizeof (wide.pool.data[0]) + sizeof (uint32_t))
+                    / count);
+
+        binary.clean ();
+        wide.clean ();
+        probes.clean ();
+        random.clean ();
+    }
+
+    // The producer inserting `rate` keys a second, or flat out at 0,
+    // against a renderer ticking at 60 fps without a window: each tick
+    // takes the published copy, lays it out and culls it as a frame
+    // would, then sleeps to the next tick. Reports the sustained insert
+    // rate and the frames' time
+    void live (size_t seconds, size_t rate)
+    {
+        Feed<float>  feed;
+        Array<float> seed = stream (RANDOM, 100000);
+
+        feed.seed (seed);
+
+        uint64_t state = 88172645463325252ull;
+
+        feed.start (rate, [state] () mutable -> float {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+
+            return (float)(state % 1000000);
+        });
+
+        Array<double> times;
+        size_t        missed = 0;
+        double        start = now (), tick = start;
+
+        while (now () - start < seconds)
+        {
+            double frame = now ();
+
+            Tree<float>& copy = feed.acquire ();
+
+            graphics::layout (copy);
+            graphics::cull (copy, graphics::camera.view (),
+                            graphics::camera.zoom);
+
+            feed.release ();
+
+            times.push ((now () - frame) * 1000.0);
+
+            tick += 1.0 / 60;
+
+            double left = tick - now ();
+
+            if (left > 0) SDL_Delay ((Uint32)(left * 1000.0));
+            else {
+                missed++;
+                tick = now ();
+            }
+        }
+
+        double   wall      = now () - start;
+        uint32_t published = feed.published.load ();
+
+        feed.finish ();
+
+        std::sort (times.data, times.data + times.length);
+
+        printf ("%zu s, %d cores: %zu frames (%.1f fps), %zu missed ticks\n",
+                seconds, (int)std::thread::hardware_concurrency (),
+                times.length, times.length / wall, missed);
+        printf ("inserts: %.0f/s sustained, %u keys drawn, %u queued\n",
+                (published - seed.length) / wall, published,
+                feed.received.load () - published);
+        printf ("frame ms: p50 %.3f, p99 %.3f, max %.3f\n",
+                times.data[times.length / 2],
+                times.data[times.length * 99 / 100],
+                times.data[times.length - 1]);
+
+        graphics::nodes.length = 0;
+        graphics::grid.clear ();
+
+        times.clean ();
+        seed.clean ();
+        feed.clean ();
+    }
+
+    // Full relayouts of `count` keys on 1, 2, 4 ... workers, up to `most`:
+    // the placement walk, which is what gets split, and the whole layout,
+    // whose grid and extent passes stay on one thread
+    void scaling (size_t count, int most)
+    {
+        Tree<float> tree = random_tree (count);
+
+        auto touch = [&] () {
+            for (size_t i = 1; i < tree.pool.length; i++)
+                tree.pool.data[i].dirty = true;
+
+            tree.changed = true;
+        };
+
+        graphics::layout (tree);
+
+        printf ("%zu keys, %d cores\n", count,
+                (int)std::thread::hardware_concurrency ());
+        printf ("%8s %10s %10s %10s %10s\n", "workers", "place ms",
+                "speedup", "layout ms", "speedup");
+
+        double place_one = 0, layout_one = 0;
+
+        for (int threads = 1;; threads *= 2)
+        {
+            if (threads > most) threads = most;
+
+            Workers workers;
+
+            workers.start (threads);
+
+            touch ();
+
+            for (size_t i = 0; i < graphics::nodes.length; i++)
+                graphics::nodes.data[i].length = 0;
+
+            graphics::moved.length = 0;
+
+            double start = now ();
+
+            graphics::update_nodes (tree, tree.root, { 0, 1 }, workers);
+
+            double place = (now () - start) * 1000.0;
+
+            touch ();
+
+            graphics::nodes.length = 0;
+            graphics::grid.clear ();
+
+            start = now ();
+
+            graphics::layout (tree, &workers);
+
+            double layout = (now () - start) * 1000.0;
+
+            if (threads == 1)
+            {
+                place_one  = place;
+                layout_one = layout;
+            }
+
+            printf ("%8d %10.1f %9.2fx %10.1f %9.2fx\n", threads, place,
+                    place_one / place, layout, layout_one / layout);
+
+            workers.finish ();
+
+            if (threads == most) break;
+        }
+
+        graphics::nodes.length = 0;
+        graphics::grid.clear ();
+
+        tree.clean ();
+    }
+
+    // Sorts the samples and prints the 50th, 90th and 99th percentile
+    void percentiles (const char* name, Array<double>& ms)
+    {
+        if (!ms.length) return;
+
+        std::sort (ms.data, ms.data + ms.length);
+
+        printf ("%-10s ms: p50 %7.3f, p90 %7.3f, p99 %7.3f\n", name,
+                ms.data[ms.length / 2], ms.data[ms.length * 9 / 10],
+                ms.data[ms.length * 99 / 100]);
+    }
+
+    // Frames of a zoomed-out, panning camera over `count` keys, built in
+    // place on one thread and then by the pipeline's build stage on every
+    // core. Submission is stood in for by the copy into the instance
+    // stream, the part of flush that scales with the frame
+    void pipeline (size_t count)
+    {
+        Tree<float>     tree = random_tree (count);
+        Array<Instance> out;
+        int             cores = (int)std::thread::hardware_concurrency ();
+
+        graphics::layout (tree);
+
+        Vec2 root = graphics::nodes.data[tree.root].pos;
+
+        printf ("%zu keys, %d cores\n", count, cores);
+
+        for (int pipelined = 0; pipelined < 2; pipelined++)
+        {
+            graphics::Pipeline pipeline;
+            graphics::Camera   camera;
+            Array<double>      build, submit, interval;
+
+            pipeline.start (pipelined ? cores : 1, pipelined,
+                            [&] (graphics::Frame& frame) {
+                                graphics::frame (tree, frame,
+                                                 pipeline.workers);
+                            });
+
+            camera.zoom = 0.05f;
+            camera.center (root);
+
+            double start = now (), last = start;
+
+            auto present = [&] () {
+                graphics::Frame& frame = pipeline.take ();
+                double           begin = now ();
+
+                out.length = 0;
+
+                for (int pass = 0; pass < 3; pass++)
+                    for (graphics::Batch& part : frame.parts)
+                        for (Instance& instance : part.pass (pass))
+                            out.push (instance);
+
+                build.push ((frame.built - frame.asked) * 1000.0
+                            / SDL_GetPerformanceFrequency ());
+                submit.push ((now () - begin) * 1000.0);
+                interval.push ((now () - last) * 1000.0);
+
+                last = now ();
+
+                pipeline.recycle (frame);
+            };
+
+            for (int i = 0; i < 300; i++)
+            {
+                camera.pan ({ i % 60 < 30 ? 8.f : -8.f, 0 });
+                pipeline.request (camera);
+
+                if (pipeline.in_flight > pipelined) present ();
+            }
+
+            while (pipeline.in_flight) present ();
+
+            printf ("%s: %.1f fps, %zu instances a frame\n",
+                    pipelined ? "pipelined" : "serial",
+                    interval.length / (now () - start), out.length);
+
+            percentiles ("build", build);
+            percentiles ("submit", submit);
+            percentiles ("interval", interval);
+
+            pipeline.finish ();
+            build.clean ();
+            submit.clean ();
+            interval.clean ();
+        }
+
+        graphics::nodes.length = 0;
+        graphics::grid.clear ();
+
+        out.clean ();
+        tree.clean ();
+    }
+
+    // Parse throughput of a generated key file: strtof over the mapped
+    // text against the word-at-a-time parser on one thread and on every
+    // core, then the bulk build of what was parsed
+    void parse (size_t count)
+    {
+        const char* filename = "bench-keys.txt";
+
+        FILE* fp = fopen (filename, "w");
+
+        assert (fp != nullptr);
+
+        srand (count);
+
+        for (size_t i = 0; i < count; i++)
+            fprintf (fp, "%.6f\n", rand () / (float)RAND_MAX * 1e6f - 5e5f);
+
+        fclose (fp);
+
+        int cores = std::thread::hardware_concurrency ();
+
+        if (cores < 1) cores = 1;
+
+        double       start = now ();
+        keys::Mapped file  = keys::map (filename);
+
+        printf ("%zu keys, %.1f MB, %d cores\n", count, file.length / 1e6,
+                cores);
+        printf ("%-14s %7s %12s %10s\n", "method", "threads", "ms", "MB/s");
+        printf ("%-14s %7d %12.3f\n", "map", 1, (now () - start) * 1000.0);
+
+        Array<float> reference;
+
+        reference.reserve (count);
+
+        start = now ();
+
+        for (const char *p = file.data, *end = file.data + file.length;
+             p < end;)
+        {
+            char* next;
+
+            reference.push (strtof (p, &next));
+
+            p = next;
+
+            while (p < end && keys::separator (*p)) p++;
+        }
+
+        double time = now () - start;
+
+        printf ("%-14s %7d %12.3f %10.1f\n", "strtof", 1, time * 1000.0,
+                file.length / 1e6 / time);
+
+        Array<float> parsed;
+
+        for (int threads = 1;; threads = cores)
+        {
+            parsed.length = 0;
+
+            start = now ();
+            keys::parse (file.data, file.length, parsed, threads);
+            time = now () - start;
+
+            printf ("%-14s %7d %12.3f %10.1f\n", "parse", threads,
+                    time * 1000.0, file.length / 1e6 / time);
+
+            if (threads == cores) break;
+        }
+
+        size_t mismatched = 0;
+
+        assert (parsed.length == reference.length);
+
+        for (size_t i = 0; i < parsed.length; i++)
+            if (parsed.data[i] != reference.data[i]) mismatched++;
+
+        printf ("%zu of %zu keys differ from strtof\n", mismatched,
+                parsed.length);
+
+        Tree<float> tree;
+
+        start = now ();
+        tree.build (parsed);
+
+        printf ("%-14s %7d %12.3f\n", "build", cores,
+                (now () - start) * 1000.0);
+
+        tree.clean ();
+        parsed.clean ();
+        reference.clean ();
+        file.clean ();
+
+        remove (filename);
+    }
+
+    // Label formatting: the old truncating sprintf, sprintf with enough
+    // digits to round-trip, and keys::format at full and reduced precision
+    void labels (size_t count)
+    {
+        Array<float> values = stream (RANDOM, count);
+
+        for (size_t i = 0; i < count; i++)
+            values.data[i] = values.data[i] / RAND_MAX * 2e6f - 1e6f;
+
+        char   str[32];
+        size_t bytes = 0;
+
+        printf ("%zu keys\n", count);
+        printf ("%-16s %12s %10s %12s\n", "method", "ms", "ns/key",
+                "round-trip");
+
+        for (int method = 0; method < 4; method++)
+        {
+            const char* names[] = { "sprintf %0.f", "sprintf %.9g",
+                                    "format", "format 4 digits" };
+
+            double start = now ();
+
+            for (size_t i = 0; i < count; i++)
+            {
+                float key = values.data[i];
+
+                switch (method)
+                {
+                    case 0: bytes += sprintf (str, "%0.f", key); break;
+                    case 1: bytes += sprintf (str, "%.9g", key); break;
+                    case 2: bytes += keys::format (key, str); break;
+                    case 3: bytes += keys::format (key, str, 4); break;
+                }
+            }
+
+            double time = now () - start;
+            size_t exact = 0;
+
+            for (size_t i = 0; i < count; i += 16)
+            {
+                float key = values.data[i];
+
+                switch (method)
+                {
+                    case 0: sprintf (str, "%0.f", key); break;
+                    case 1: sprintf (str, "%.9g", key); break;
+                    case 2: keys::format (key, str); break;
+                    case 3: keys::format (key, str, 4); break;
+                }
+
+                exact += strtof (str, nullptr) == key;
+            }
+
+            printf ("%-16s %12.3f %10.1f %11.1f%%\n", names[method],
+                    time * 1000.0, time * 1e9 / count,
+                    exact * 100.0 / ((count + 15) / 16));
+        }
+
+        printf ("(%zu bytes written)\n", bytes);
+
+        values.clean ();
+    }
+
+    // A tree of short identifiers: insert throughput and heap allocations
+    // made while inserting, then one layout and a culled batch over it
+    void strings (size_t count)
+    {
+        Array<string> names;
+
+        names.reserve (count);
+        srand (count);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            char str[32];
+            int  length = sprintf (str, "node_%08x", rand () ^ rand () << 16);
+
+            names.push (string (str, length));
+        }
+
+        Tree<string> tree;
+
+        tree.pool.reserve (count + 1);
+
+        size_t allocations = string::allocations;
+        double start       = now ();
+
+        for (size_t i = 0; i < count; i++) tree.push (names.data[i]);
+
+        double time = now () - start;
+
+        printf ("%zu keys, %zu bytes per string, %zu per node\n", count,
+                sizeof (string), sizeof (Tree<string>::Node));
+        printf ("push   %10.3f ms %12.0f inserts/s, height %d, %zu "
+                "allocations\n",
+                time * 1000.0, count / time, tree.height (),
+                string::allocations - allocations);
+
+        start = now ();
+        graphics::layout (tree);
+
+        printf ("layout %10.3f ms %9zu nodes\n", (now () - start) * 1000.0,
+                graphics::relaid);
+
+        start = now ();
+
+        graphics::cull (tree, graphics::camera.view (), graphics::camera.zoom);
+        graphics::batch.push (graphics::nodes, graphics::visible);
+        graphics::batch.push_summaries (tree, graphics::nodes,
+                                        graphics::summaries,
+                                        graphics::camera.zoom);
+
+        printf ("frame  %10.3f ms %9zu instances\n",
+                (now () - start) * 1000.0, graphics::batch.length ());
+
+        graphics::batch.clear ();
+        graphics::nodes.length = 0;
+        graphics::grid.clear ();
+
+        tree.clean ();
+        names.clean ();
+    }
+
+    // std::vector under the Array names used below
+    template <class T> struct Vector : std::vector<T>
+    {
+        void push (const T& value) { this->push_back (value); }
+        void clean () { std::vector<T> ().swap (*this); }
+
+        template <class... Args> T& emplace (Args&&... args)
+        {
+            this->emplace_back (std::forward<Args> (args)...);
+            return this->back ();
+        }
+    };
+
+    // Growing from empty, growing after a reserve and summing over floats,
+    // then emplacing a quarter as many Vec4s
+    template <template <class> class C>
+    void containers (const char* name, size_t count)
+    {
+        double times[4];
+        double start = now ();
+
+        C<float> a;
+
+        for (size_t i = 0; i < count; i++) a.push (i);
+
+        times[0] = now () - start;
+        start    = now ();
+
+        C<float> b;
+
+        b.reserve (count);
+
+        for (size_t i = 0; i < count; i++) b.push (i);
+
+        times[1] = now () - start;
+        start    = now ();
+
+        double sum = 0;
+
+        for (float value : a) sum += value;
+
+        times[2] = now () - start;
+
+        a.clean ();
+        b.clean ();
+
+        C<Vec4> vectors;
+
+        start = now ();
+
+        for (size_t i = 0; i < count / 4; i++) vectors.emplace (i, 0, 1, 1);
+
+        times[3] = now () - start;
+
+        printf ("%-12s %10.3f %10.3f %10.3f %10.3f   (%g)\n", name,
+                times[0] * 1000.0, times[1] * 1000.0, times[2] * 1000.0,
+                times[3] * 1000.0, sum);
+
+        vectors.clean ();
+    }
+
+    void containers (size_t count)
+    {
+        printf ("%zu floats, %zu Vec4s, ms\n", count, count / 4);
+        printf ("%-12s %10s %10s %10s %10s\n", "container", "push",
+                "reserved", "iterate", "emplace");
+
+        for (int round = 0; round < 2; round++)
+        {
+            containers<Array> ("Array", count);
+            containers<Vector> ("std::vector", count);
+        }
+    }
+
+    // Frame time of the per-quad path against the instanced batch
+    void draw (SDL_Window* window, Shader& shader, size_t max_count)
+    {
+        const int frames = 10;
+
+        for (size_t count = 1000; count <= max_count; count *= 10)
+        {
+            Tree<float> tree = random_tree (count);
+
+            graphics::layout (tree);
+
+            double times[2];
+            size_t calls[2], skipped[2];
+
+            for (int mode = 0; mode < 2; mode++)
+            {
+                glFinish ();
+
+                double start = now ();
+
+                gl_stats.reset ();
+
+                for (int i = 0; i < frames; i++)
+                {
+                    glClear (GL_COLOR_BUFFER_BIT);
+
+                    shader.use ();
+
+                    if (mode == 0) graphics::draw (shader, graphics::nodes);
+                    else {
+                        graphics::batch.push (graphics::nodes);
+                        graphics::batch.flush (shader);
+                    }
 
-        glBindVertexArray (vao);
-        glBindBuffer (GL_ARRAY_BUFFER, vbo);
+                    SDL_GL_SwapWindow (window);
+                }
 
-        glVertexAttribPointer (0, 2, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray (0);
+                glFinish ();
 
-        glBufferData (GL_ARRAY_BUFFER, sizeof (points), points, GL_STATIC_DRAW);
-    }
+                times[mode]   = (now () - start) * 1000.0 / frames;
+                calls[mode]   = gl_stats.calls / frames;
+                skipped[mode] = gl_stats.skipped / frames;
+            }
 
-    void use ()
-    {
-        glBindVertexArray (vao);
-        glUseProgram (id);
+            printf ("%8zu nodes: per-quad %10.3f ms %9zu calls %9zu skipped"
+                    "  batched %8.3f ms %3zu calls\n",
+                    count, times[0], calls[0], skipped[0], times[1], calls[1]);
+
+            // The next size lays out from scratch
+            graphics::nodes.length = 0;
+            graphics::grid.clear ();
+        }
     }
-};
+}
 
-namespace graphics
+// Centres the camera on the k-th key of the live tree or the snapshot
+template <class Tr> void locate (Tr& tree, uint32_t k)
 {
-    Vec2 NODE_SIZE = { 16.f, 16.f };
+    uint32_t size = tree.size ();
 
-    struct Node
-    {
-        Vec2  pos;
-        char  str[20];
-        Node *left, *right;
-    };
+    if (!size) return;
 
-    TTF_Font*   font = nullptr;
-    Array<Node> nodes;
+    if (k >= size) k = size - 1;
 
-    Array<kv<char, Texture> > charset;
+    uint32_t node = tree.select (k);
 
-    Node* update_nodes (Tree<float>::Node* t_node, Vec2 curr = { 0, 0 })
+    graphics::layout (tree);
+    graphics::camera.center (graphics::nodes.data[node].pos);
+
+    printf ("key %g, rank %u of %u\n", tree[node].data, k, size);
+}
+
+int main (int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
     {
-        if (!t_node) return nullptr;
+        if (strcmp (argv[i], "--bench-layout") == 0)
+        {
+            bench::layout ();
+            return 0;
+        }
 
-        float l_height = Tree<float>::height (t_node->left, 1) * 3;
+        if (strcmp (argv[i], "--bench-incremental") == 0)
+        {
+            size_t count = 1000000;
 
-        Vec2 pos = { curr.x + l_height + 1, curr.y };
+            if (i + 1 < argc) count = strtoul (argv[i + 1], nullptr, 10);
 
-        Node* node = &nodes.push ({ pos * NODE_SIZE, {}, nullptr, nullptr });
+            bench::incremental (count);
+            return 0;
+        }
 
-        sprintf (node->str, "%0.f", t_node->data);
+        if (strcmp (argv[i], "--bench-cull") == 0)
+        {
+            size_t count = 1000000;
 
-        node->left  = update_nodes (t_node->left, { curr.x, curr.y + 2 });
-        node->right = update_nodes (t_node->right, { pos.x + 1, curr.y + 2 });
+            if (i + 1 < argc) count = strtoul (argv[i + 1], nullptr, 10);
 
-        return node;
-    }
+            bench::cull (count);
+            return 0;
+        }
 
-    Texture get_char (char c)
-    {
-        for (size_t i = 0; i < charset.length; i++)
-            if (charset[i].key == c) return charset[i].val;
+        if (strcmp (argv[i], "--bench-lod") == 0)
+        {
+            size_t count = 1000000;
 
-        const char text[2] = { c, '\0' };
+            if (i + 1 < argc) count = strtoul (argv[i + 1], nullptr, 10);
 
-        SDL_Surface* surface
-            = TTF_RenderText_Solid (font, text, { 255, 255, 200 });
+            bench::lod (count);
+            return 0;
+        }
 
-        return charset.push ({ c, Texture (surface) }).val;
-    }
+        if (strcmp (argv[i], "--bench-math") == 0)
+        {
+            size_t count = 10000000;
 
-    void draw_line (Shader shader, Node* a, Node* b, Vec2 height = { 16, 16 })
-    {
-        if (!b) return;
+            if (i + 1 < argc) count = strtoul (argv[i + 1], nullptr, 10);
 
-        Vec2 diff = (a->pos - b->pos) / 2.f;
-        Vec2 line = {
-            b->pos.x + ((strlen (b->str) * height.x) / 2.f),
-            b->pos.y + (diff.y + (height.y / 2.f)),
-        };
+            bench::math (count);
+            return 0;
+        }
 
-        float angle = a->pos.angle (line);
+        if (strcmp (argv[i], "--bench-arena") == 0)
+        {
+            size_t count = 10000000;
 
-        shader.set ("u_type", 0);
-        shader.set ("u_alpha", 1.f);
-        shader.set ("u_color", { 0, .4, 1 });
+            if (i + 1 < argc) count = strtoul (argv[i + 1], nullptr, 10);
 
-        shader.set ("u_model", get_model (line, { diff.x * 2, 2 }, angle));
-        glDrawArrays (GL_TRIANGLES, 0, 6);
-    }
+            bench::arena (count);
+            return 0;
+        }
 
-    void draw (Shader shader, Node* a)
-    {
-        if (!a) return;
+        if (strcmp (argv[i], "--bench-order") == 0)
+        {
+            size_t count = 10000000;
 
-        draw_line (shader, a, a->left);
-        draw_line (shader, a, a->right);
+            if (i + 1 < argc) count = strtoul (argv[i + 1], nullptr, 10);
 
-        shader.set ("u_type", 0);
-        shader.set ("u_color", { 0.8f, .2f, 0.f });
-        shader.set ("u_alpha", 1.f);
+            bench::order (count);
+            return 0;
+        }
 
-        Vec2 pos        = a->pos;
-        Vec2 block_size = { strlen (a->str) * NODE_SIZE.x, NODE_SIZE.y };
+        if (strcmp (argv[i], "--bench-frozen") == 0)
+        {
+            size_t count = 10000000;
 
-        shader.set ("u_model", get_model (pos, block_size, 0));
-        glDrawArrays (GL_TRIANGLES, 0, 6);
+            if (i + 1 < argc) count = strtoul (argv[i + 1], nullptr, 10);
 
-#if 1
-        shader.set ("u_type", 2);
+            bench::frozen (count);
+            return 0;
+        }
 
-        for (size_t j = 0; j < strlen (a->str); j++)
+        if (strcmp (argv[i], "--bench-btree") == 0)
         {
-            Texture t = get_char (a->str[j]);
+            size_t count = 10000000;
 
-            glBindTexture (GL_TEXTURE_2D, t.id);
+            if (i + 1 < argc) count = strtoul (argv[i + 1], nullptr, 10);
 
-            shader.set ("u_model", get_model (pos, NODE_SIZE, 0));
-            glDrawArrays (GL_TRIANGLES, 0, 6);
+            bench::btree (count);
+            return 0;
+        }
+
+        if (strcmp (argv[i], "--bench-live") == 0)
+        {
+            size_t seconds = 10, rate = 0;
+
+            if (i + 1 < argc) seconds = strtoul (argv[i + 1], nullptr, 10);
+            if (i + 2 < argc) rate = strtoul (argv[i + 2], nullptr, 10);
 
-            pos.x += NODE_SIZE.x;
+            bench::live (seconds, rate);
+            return 0;
         }
-#endif
 
-#if 0
-    shader.set ("u_type", 1);
+        if (strcmp (argv[i], "--bench-pipeline") == 0)
+        {
+            size_t count = 1000000;
+
+            if (i + 1 < argc) count = strtoul (argv[i + 1], nullptr, 10);
 
-    for (size_t j = 0; j < strlen (a->str); j++)
-    {
-        Vec4 offset = { 0, .4, .1, .1 };
+            bench::pipeline (count);
+            return 0;
+        }
 
-        if (a->str[j] == '.')
+        if (strcmp (argv[i], "--bench-scaling") == 0)
         {
-            offset.x = .6;
-            offset.y = .2;
+            size_t count = 2000000;
+            int    most  = (int)std::thread::hardware_concurrency ();
+
+            if (i + 1 < argc) count = strtoul (argv[i + 1], nullptr, 10);
+            if (i + 2 < argc) most = atoi (argv[i + 2]);
+
+            bench::scaling (count, most < 1 ? 1 : most);
+            return 0;
         }
-        else if (a->str[j] == '-') {
-            offset.x = .7;
-            offset.y = .2;
+
+        if (strcmp (argv[i], "--bench-build") == 0)
+        {
+            size_t count = 10000000;
+
+            if (i + 1 < argc) count = strtoul (argv[i + 1], nullptr, 10);
+
+            bench::build (count);
+            return 0;
         }
-        else offset.x = (a->str[j] - 48) / 10.f;
 
-        shader.set ("u_offset", offset);
-        shader.set ("u_model", get_model (pos, height, 0));
-        glDrawArrays (GL_TRIANGLES, 0, 6);
+        if (strcmp (argv[i], "--bench-parse") == 0)
+        {
+            size_t count = 10000000;
 
-        pos.x += 16;
-    }
-#endif
+            if (i + 1 < argc) count = strtoul (argv[i + 1], nullptr, 10);
+
+            bench::parse (count);
+            return 0;
+        }
+
+        if (strcmp (argv[i], "--bench-labels") == 0)
+        {
+            size_t count = 10000000;
+
+            if (i + 1 < argc) count = strtoul (argv[i + 1], nullptr, 10);
+
+            bench::labels (count);
+            return 0;
+        }
+
+        if (strcmp (argv[i], "--bench-strings") == 0)
+        {
+            size_t count = 10000000;
+
+            if (i + 1 < argc) count = strtoul (argv[i + 1], nullptr, 10);
+
+            bench::strings (count);
+            return 0;
+        }
+
+        if (strcmp (argv[i], "--bench-array") == 0)
+        {
+            size_t count = 100000000;
+
+            if (i + 1 < argc) count = strtoul (argv[i + 1], nullptr, 10);
+
+            bench::containers (count);
+            return 0;
+        }
 
-        draw (shader, a->left);
-        draw (shader, a->right);
+        if (strcmp (argv[i], "--bench-balance") == 0)
+        {
+            size_t count = 1000000;
+
+            if (i + 1 < argc) count = strtoul (argv[i + 1], nullptr, 10);
+
+            bench::balance (count);
+            return 0;
+        }
     }
 
-}
+    // --startup splits launch time into phases, with the shader program
+    // either compiled (cold) or loaded from the binary cache (warm)
+    double launch = bench::now (), phases[4];
 
-int main (int argc, char** argv)
-{
     SDL_Init (SDL_INIT_EVERYTHING);
     TTF_Init ();
 
@@ -958,6 +6820,8 @@ int main (int argc, char** argv)
 
     SDL_GL_SetSwapInterval (0);
 
+    phases[0] = bench::now ();
+
     glEnable (GL_BLEND);
     glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
@@ -970,47 +6834,474 @@ int main (int argc, char** argv)
         = { 5,  3,  2,  4,    7,  6,  8,  15, 10, 9,   11,  16,  15.5, 13, -1,
             -2, -3, -4, 15.2, 14, 20, 25, 30, 40, 560, -10, -20, -30,  -35 };
 
-    Texture spritesheet (font_xpm);
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp (argv[i], "--keys") == 0)
+        {
+            keys::Mapped file;
+            Array<float> values = keys::load (argv[i + 1], file);
+
+            if (file.error)
+            {
+                printf ("%s: %s\n", argv[i + 1], strerror (file.error));
+
+                SDL_Quit ();
+                return 1;
+            }
+
+            printf ("%zu keys from %s\n", values.length, argv[i + 1]);
+
+            if (values.length) tree.build (values);
+
+            values.clean ();
+        }
+    }
+
+    // --freeze trades the live tree for its read-only snapshot, which is
+    // what gets searched and drawn from then on
+    Frozen<float> frozen;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp (argv[i], "--freeze") == 0 && !frozen.length)
+        {
+            frozen = tree.freeze ();
+            tree.clean ();
+        }
+    }
+
+    auto sorted = [&] () {
+        Array<float> keys;
+
+        keys.reserve (tree.size ());
+
+        tree.inorder (tree.root, [&] (Tree<float>::Index node) {
+            keys.push (tree[node].data);
+        });
+
+        return keys;
+    };
+
+    // --btree moves the keys into a B-tree, drawn a row of keys per node
+    BTree<float> wide;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp (argv[i], "--btree") == 0 && !frozen.length && !wide.root)
+        {
+            Array<float> keys = sorted ();
+
+            wide.build (keys);
+            tree.clean ();
+            keys.clean ();
+        }
+    }
+
+    // --live [rate] has a producer thread insert random keys, `rate` a
+    // second or as fast as it can, while the window keeps drawing
+    Feed<float> feed;
+    bool        live  = false;
+    size_t      rate  = 0;
+    uint32_t    drawn = 0;    // keys in the copy the last frame showed
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp (argv[i], "--live") == 0 && !frozen.length && !wide.root)
+        {
+            live = true;
+
+            if (i + 1 < argc && keys::digit (argv[i + 1][0]))
+                rate = strtoul (argv[i + 1], nullptr, 10);
+        }
+    }
+
+    if (live)
+    {
+        Array<float> keys = sorted ();
+
+        feed.seed (keys);
+        tree.clean ();
+        keys.clean ();
+
+        uint64_t state = 88172645463325252ull;
+
+        feed.start (rate, [state] () mutable -> float {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+
+            return (state % 2000001) / 1000.f - 1000.f;
+        });
+    }
+
+    // Only the live feed changes the tree after the first frame, and the
+    // tree itself may be in the build stage's hands
+    auto changed = [&] () {
+        return live && feed.published.load () != drawn;
+    };
+
+    double start = bench::now ();
 
     Shader shader ("vertex.glsl", "fragment.glsl");
 
+    phases[1] = bench::now () - start;
+    start     = bench::now ();
+
+    graphics::atlas.init (graphics::font, font_xpm);
+
+    phases[2] = bench::now () - start;
+
+    glActiveTexture (GL_TEXTURE0);
+    glBindTexture (GL_TEXTURE_2D, graphics::atlas.texture.id);
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp (argv[i], "--bench-draw") == 0)
+        {
+            size_t max_count = 1000000;
+
+            if (i + 1 < argc) max_count = strtoul (argv[i + 1], nullptr, 10);
+
+            bench::draw (window, shader, max_count);
+
+            SDL_Quit ();
+            return 0;
+        }
+    }
+
     int fw, fh;
 
     TTF_SizeText (graphics::font, "a", &fw, &fh);
 
     Vec2 mouse;
 
+    // Frames are drawn only when something changed, waiting on events in
+    // between. --continuous draws flat out as before, --vsync and --fps
+    // pace whichever mode runs
+    bool   stats = false, startup = false, continuous = false, dirty = true;
+    size_t frames = 0, fps = 0;
+    double second = bench::now (), cpu = bench::cpu (), swapped = second;
+
+    // --workers n fills each frame on n threads, 0 for one per core, and
+    // --pipeline builds the next frame on its own thread while this one
+    // is submitted
+    int  threads   = 1;
+    bool pipelined = false;
+
+    // Per frame in ms: asked to built, built to swapped, swap to swap
+    Array<double> builds, submits, intervals;
+
+    // Input to swap in ms, from the event's timestamp to the swap after it
+    Uint32 input = 0;
+    double latency = 0, latency_max = 0;
+    size_t latencies = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp (argv[i], "--stats") == 0) stats = true;
+        if (strcmp (argv[i], "--startup") == 0) startup = true;
+        if (strcmp (argv[i], "--continuous") == 0) continuous = true;
+        if (strcmp (argv[i], "--vsync") == 0) SDL_GL_SetSwapInterval (1);
+
+        if (strcmp (argv[i], "--fps") == 0 && i + 1 < argc)
+            fps = strtoul (argv[i + 1], nullptr, 10);
+
+        if (strcmp (argv[i], "--precision") == 0 && i + 1 < argc)
+            graphics::precision = atoi (argv[i + 1]);
+
+        if (strcmp (argv[i], "--workers") == 0 && i + 1 < argc)
+            threads = atoi (argv[i + 1]);
+
+        if (strcmp (argv[i], "--pipeline") == 0) pipelined = true;
+    }
+
+    if (live && !fps) fps = 60;
+
+    if (threads == 0) threads = (int)std::thread::hardware_concurrency ();
+
+    graphics::Pipeline pipeline;
+
+    pipeline.start (threads, pipelined, [&] (graphics::Frame& frame) {
+        Workers& workers = pipeline.workers;
+
+        if (live)
+        {
+            // The frame keeps its own copy of what it drew, so the tree
+            // goes back to the producer before the GL work
+            Tree<float>& copy = feed.acquire ();
+
+            graphics::frame (copy, frame, workers);
+
+            frame.drawn = copy.size ();
+
+            feed.release ();
+        }
+        else if (frozen.length) graphics::frame (frozen, frame, workers);
+        else if (wide.root) graphics::frame (wide, frame, workers);
+        else graphics::frame (tree, frame, workers);
+    });
+
+    uint32_t inserted = drawn;    // published keys at the last stats line
+
+    // '/' starts typing a key and 'n' a rank, Enter jumps the camera to
+    // that node (or the next key up) and Escape drops the query. Both go
+    // through select, so a jump costs two root-to-leaf walks at any size
+    char   query[32];
+    size_t query_length = 0;
+    int    query_mode   = 0;
+
+    auto jump = [&] () {
+        query[query_length] = 0;
+
+        if (!query_length) return;
+
+        float    key = strtof (query, nullptr);
+        uint32_t k   = strtoul (query, nullptr, 10);
+
+        pipeline.drain ();
+
+        if (query_mode != SDLK_n)
+            k = frozen.length ? frozen.rank (key)
+                : wide.root   ? wide.rank (key)
+                              : tree.rank (key);
+
+        if (live)
+        {
+            Tree<float>& copy = feed.acquire ();
+
+            locate (copy, query_mode == SDLK_n ? k : copy.rank (key));
+
+            feed.release ();
+        }
+        else if (frozen.length) locate (frozen, k);
+        else if (wide.root) locate (wide, k);
+        else locate (tree, k);
+    };
+
+    auto type = [&] (SDL_Keycode key) {
+        if (key == SDLK_RETURN)
+        {
+            jump ();
+            query_mode = 0;
+        }
+        else if (key == SDLK_ESCAPE) query_mode = 0;
+        else if (key == SDLK_BACKSPACE && query_length) query_length--;
+        else if (query_length + 1 < sizeof query
+                 && ((key >= SDLK_0 && key <= SDLK_9) || key == SDLK_PERIOD
+                     || key == SDLK_MINUS || key == SDLK_e))
+            query[query_length++] = (char)key;
+    };
+
+    auto handle = [&] (SDL_Event& event) {
+        bool redraw = true;
+
+        switch (event.type)
+        {
+            case SDL_QUIT: run = false; break;
+            case SDL_MOUSEMOTION:
+                mouse.x = event.motion.x;
+                mouse.y = event.motion.y;
+
+                if (event.motion.state & SDL_BUTTON_LMASK)
+                    graphics::camera.pan ({ (float)event.motion.xrel,
+                                            (float)event.motion.yrel });
+                else redraw = false;
+                break;
+            case SDL_KEYDOWN:
+                if (query_mode)
+                {
+                    type (event.key.keysym.sym);
+
+                    redraw = !query_mode;
+                }
+                else if (event.key.keysym.sym == SDLK_SLASH
+                         || event.key.keysym.sym == SDLK_n)
+                {
+                    query_mode   = event.key.keysym.sym;
+                    query_length = 0;
+                    redraw       = false;
+                }
+                else if (event.key.keysym.sym == SDLK_l)
+                    graphics::lod = graphics::lod > 0 ? 0 : 24;
+                else redraw = false;
+                break;
+            case SDL_MOUSEWHEEL:
+                // Horizontal scrolling leaves y at 0 and the zoom alone
+                if (event.wheel.y > 0)
+                    graphics::camera.zoom_at (mouse, 1.25f);
+                else if (event.wheel.y < 0)
+                    graphics::camera.zoom_at (mouse, 0.8f);
+                else redraw = false;
+                break;
+            case SDL_WINDOWEVENT: break;
+            default: redraw = false;
+        }
+
+        if (redraw && !dirty) input = event.common.timestamp;
+
+        dirty |= redraw;
+    };
+
+    gl_stats.reset ();
+
+    phases[3] = bench::now ();
+
     while (run)
     {
-        while (SDL_PollEvent (&event))
+        if (!continuous && !dirty && !changed () && !pipeline.in_flight)
+        {
+            // Stats still print once a second while idle
+            int timeout = 1000 - (int)((bench::now () - second) * 1000.0);
+
+            // Overdue means print now, not wait for the next event
+            if (!stats) timeout = -1;
+            else if (timeout < 0) timeout = 0;
+
+            // A live feed changes without events, look again every frame
+            if (live && (timeout < 0 || timeout > 16)) timeout = 16;
+
+            if (timeout < 0 ? SDL_WaitEvent (&event)
+                            : SDL_WaitEventTimeout (&event, timeout))
+                handle (event);
+        }
+
+        while (SDL_PollEvent (&event)) handle (event);
+
+        // With a build stage a frame stays in flight while there is more to
+        // draw, so the next one is built while this one is submitted
+        bool more = continuous || dirty || changed ();
+
+        if (more)
+        {
+            pipeline.request (graphics::camera);
+            dirty = false;
+        }
+
+        if (pipeline.in_flight > (more && pipelined ? 1 : 0))
         {
-            switch (event.type)
+            graphics::Frame& frame = pipeline.take ();
+            double           begin = bench::now ();
+
+            glClearColor (0.f, 0.f, 0.f, 1.f);
+            glClear (GL_COLOR_BUFFER_BIT);
+
+            shader.use ();
+
+            if (live) drawn = frame.drawn;
+
+            builds.push ((frame.built - frame.asked) * 1000.0
+                         / SDL_GetPerformanceFrequency ());
+
+            pipeline.submit (shader, frame);
+
+            SDL_GL_SwapWindow (window);
+
+            frames++;
+
+            submits.push ((bench::now () - begin) * 1000.0);
+
+            if (input)
             {
-                case SDL_QUIT: run = false; break;
-                case SDL_MOUSEMOTION:
-                    int x, y;
+                // Waits for the GPU so the figure covers the whole frame
+                if (stats) glFinish ();
 
-                    SDL_GetMouseState (&x, &y);
+                double ms = SDL_GetTicks () - input;
 
-                    mouse.x = x;
-                    mouse.y = y;
-                    break;
+                latency += ms;
+                latencies++;
+
+                if (ms > latency_max) latency_max = ms;
+
+                input = 0;
+            }
+
+            if (startup)
+            {
+                double end = bench::now ();
+
+                printf ("startup %.3f ms: context %.3f, shader %.3f (%s), "
+                        "atlas %.3f, first frame %.3f\n",
+                        (end - launch) * 1000.0, (phases[0] - launch) * 1000.0,
+                        phases[1] * 1000.0,
+                        shader.cached ? "cached" : "compiled",
+                        phases[2] * 1000.0, (end - phases[3]) * 1000.0);
+
+                startup = false;
+            }
+
+            if (fps)
+            {
+                double left = 1.0 / fps - (bench::now () - swapped);
+
+                if (left > 0) SDL_Delay ((Uint32)(left * 1000.0));
             }
+
+            intervals.push ((bench::now () - swapped) * 1000.0);
+
+            swapped = bench::now ();
         }
 
-        glClearColor (0.f, 0.f, 0.f, 1.f);
-        glClear (GL_COLOR_BUFFER_BIT);
+        if (stats && bench::now () - second >= 1)
+        {
+            double wall = bench::now () - second;
+
+            printf ("%zu fps, cpu %.1f%%, input latency avg %.1f ms max %.1f "
+                    "ms\n",
+                    frames, (bench::cpu () - cpu) / wall * 100.0,
+                    latencies ? latency / latencies : 0.0, latency_max);
+
+            bench::percentiles ("build", builds);
+            bench::percentiles ("submit", submits);
+            bench::percentiles ("interval", intervals);
 
-        shader.use ();
-        glBindTexture (GL_TEXTURE0, spritesheet.id);
+            if (live)
+            {
+                uint32_t total = feed.published.load ();
 
-        graphics::update_nodes (tree.root, { 0, 1 });
-        graphics::draw (shader, &graphics::nodes[0]);
+                printf ("live: %.0f inserts/s, %u keys, %u queued\n",
+                        (total - inserted) / wall, total,
+                        feed.received.load () - total);
 
-        graphics::nodes.length = 0;
+                inserted = total;
+            }
+
+            if (frames)
+            {
+                printf ("per frame: %zu gl calls, %zu uniforms, %zu skipped, "
+                        "%zu draws\n",
+                        gl_stats.calls / frames, gl_stats.uniforms / frames,
+                        gl_stats.skipped / frames, gl_stats.draws / frames);
+
+                Stream::Stats& stream = shader.instances.stats;
+
+                printf ("stream %s: %zu KB per frame, %zu KB regions, %zu "
+                        "waits (%.3f ms), %zu orphans, %zu grows\n",
+                        shader.instances.persistent ? "persistent"
+                                                    : "orphaning",
+                        stream.bytes / frames / 1024,
+                        shader.instances.size / 1024, stream.waits,
+                        stream.waited * 1000.0, stream.orphans, stream.grows);
+
+                stream.reset ();
+            }
 
-        SDL_GL_SwapWindow (window);
+            gl_stats.reset ();
+
+            frames    = 0;
+            latency   = latency_max = 0;
+            builds.length = submits.length = intervals.length = 0;
+            latencies = 0;
+            second    = bench::now ();
+            cpu       = bench::cpu ();
+        }
     }
 
+    pipeline.finish ();
+    feed.clean ();
+
+    builds.clean ();
+    submits.clean ();
+    intervals.clean ();
+
     SDL_Quit ();
 }
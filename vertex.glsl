@@ -2,14 +2,43 @@
 
 layout (location = 0) in vec2 position;
 
+layout (location = 1) in vec4 i_rect;
+layout (location = 2) in vec4 i_color;
+layout (location = 3) in vec4 i_offset;
+layout (location = 4) in vec2 i_params;    // angle, type
+
 out vec2 tex_coords;
+out vec4 v_color;
+out vec4 v_offset;
+
+flat out int v_type;
 
 uniform mat4 u_model;
 uniform mat4 u_projection;
 
+uniform int u_instanced = 0;
+
 void main ()
 {
     tex_coords = position;
 
-    gl_Position = u_projection * u_model * vec4 (position, 1.0, 1.0);
+    if (u_instanced == 0)
+    {
+        v_type = -1;
+
+        gl_Position = u_projection * u_model * vec4 (position, 1.0, 1.0);
+        return;
+    }
+
+    vec2  size  = i_rect.zw;
+    float angle = radians (i_params.x);
+    mat2  rot   = mat2 (cos (angle), sin (angle), -sin (angle), cos (angle));
+
+    vec2 p = rot * (position * size - size * 0.5) + size * 0.5 + i_rect.xy;
+
+    v_color  = i_color;
+    v_offset = i_offset;
+    v_type   = int (i_params.y);
+
+    gl_Position = u_projection * vec4 (p, 1.0, 1.0);
 }